@@ -37,6 +37,10 @@ private:
     std::string check_get_element_time(int);
 
     std::string check_traversal_time(int);
+
+    std::string check_apply_batch_time(int);
+
+    std::string check_get_many_time(int);
 };
 
 template<typename T, size_t arr_size>
@@ -54,6 +58,8 @@ void Benchmark<T, arr_size>::run() {
         file << check_remove_by_index_time(i);
         file << check_get_element_time(i);
         file << check_traversal_time(i);
+        file << check_apply_batch_time(i);
+        file << check_get_many_time(i);
     }
     std::cout <<
             "Benchmark completed successfully.\nPath to file: /Users/skilanet/CLionProjects/KursProga1/cmake-build-debug/benchmark.txt"
@@ -234,3 +240,64 @@ std::string Benchmark<T, arr_size>::check_traversal_time(int elements) {
     oss << " Mean (ms): " << mean << "; MSE (ms): " << mse << std::endl;
     return oss.str();
 }
+
+template<typename T, size_t arr_size>
+std::string Benchmark<T, arr_size>::check_apply_batch_time(int elements) {
+    std::vector<double> times;
+    for (int i = 0; i < 15; ++i) {
+        generate_elements(elements);
+        for (auto element: elements_set) {
+            tree.insert(element);
+        }
+        std::vector<Operation<T>> operations;
+        size_t index = 0;
+        for (auto element: elements_set) {
+            operations.push_back({OPERATION::INSERT_BY_INDEX, index, element});
+            operations.push_back({OPERATION::REMOVE_BY_INDEX, index, element});
+            ++index;
+        }
+        const auto start = std::chrono::high_resolution_clock::now();
+        tree.apply_batch(operations);
+        const auto end = std::chrono::high_resolution_clock::now();
+        times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+        elements_set.clear();
+        tree.clear();
+    }
+    double mean = 0.0;
+    double mse = 0.0;
+    calculate_statistics(times, mean, mse);
+    std::ostringstream oss;
+    oss << "\tOperation - Applying batch: ";
+    oss << " Mean (ms): " << mean << "; MSE (ms): " << mse << std::endl;
+    return oss.str();
+}
+
+template<typename T, size_t arr_size>
+std::string Benchmark<T, arr_size>::check_get_many_time(int elements) {
+    std::vector<double> times;
+    for (int i = 0; i < 15; ++i) {
+        generate_elements(elements);
+        for (auto element: elements_set) {
+            tree.insert(element);
+        }
+        std::mt19937 generator(i);
+        std::uniform_int_distribution<size_t> distribution(0, elements - 1);
+        std::vector<size_t> indices(elements);
+        for (auto &index: indices) {
+            index = distribution(generator);
+        }
+        const auto start = std::chrono::high_resolution_clock::now();
+        tree.get_many(indices);
+        const auto end = std::chrono::high_resolution_clock::now();
+        times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+        elements_set.clear();
+        tree.clear();
+    }
+    double mean = 0.0;
+    double mse = 0.0;
+    calculate_statistics(times, mean, mse);
+    std::ostringstream oss;
+    oss << "\tOperation - Getting many by index: ";
+    oss << " Mean (ms): " << mean << "; MSE (ms): " << mse << std::endl;
+    return oss.str();
+}
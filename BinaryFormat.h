@@ -0,0 +1,235 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+/**
+ * Бинарный формат дерева версии 2
+ *
+ * BinaryHeader - заголовок файла: сигнатура, версия, маркер порядка байт, флаги, sizeof(T), количество элементов,
+ * размер массива конечной вершины и количество конечных вершин
+ *
+ * После заголовка идут конечные вершины в порядке логической нумерации: uint64_t количество элементов и сами
+ * элементы одним блоком, дополненным нулями до границы BINARY_ALIGNMENT байт
+ *
+ * При флаге BINARY_FLAG_LEAF_INDEX после вершин записан индекс: для каждой конечной вершины пара uint64_t -
+ * смещение её записи от начала файла и количество элементов во всех предыдущих вершинах. Последние 16 байт файла -
+ * BinaryFooter со смещением индекса, поэтому индекс находится без чтения вершин (см. MappedTree)
+ *
+ * При флаге BINARY_FLAG_DELTA_VARINT блок элементов вершины заменён на uint64_t количество сжатых байт и сами
+ * сжатые байты (см. DeltaCodec.h), флаг допустим только для целочисленных типов
+ *
+ * BinaryWriter, BinaryReader - буферизованные запись и чтение через большой буфер в памяти программы
+ */
+constexpr char BINARY_MAGIC[4] = {'K', 'T', 'R', 'E'};
+constexpr uint16_t BINARY_VERSION = 2;
+constexpr uint16_t BINARY_ENDIAN_MARKER = 0x0102;
+constexpr size_t BINARY_ALIGNMENT = 8;
+constexpr size_t BINARY_BUFFER_SIZE = 1 << 22;
+
+struct BinaryHeader {
+    char magic[4];
+    uint16_t version;
+    uint16_t endian;
+    uint32_t flags;
+    uint32_t element_size;
+    uint64_t element_count;
+    uint64_t arr_size;
+    uint64_t leaf_count;
+};
+
+static_assert(sizeof(BinaryHeader) % BINARY_ALIGNMENT == 0, "BinaryHeader must keep leaf blocks aligned");
+
+constexpr uint32_t BINARY_FLAG_LEAF_INDEX = 1u << 0;
+constexpr uint32_t BINARY_FLAG_DELTA_VARINT = 1u << 1;
+constexpr char BINARY_FOOTER_MAGIC[8] = {'K', 'T', 'R', 'E', 'I', 'D', 'X', '\0'};
+
+struct BinaryFooter {
+    uint64_t index_offset;
+    char magic[8];
+};
+
+/**
+ * ENCODING - способ записи элементов конечных вершин в бинарный файл
+ *
+ * RAW - элементы пишутся как есть
+ *
+ * DELTA_VARINT - разности соседних элементов в varint, выгодно для отсортированных целых чисел
+ */
+enum class ENCODING { RAW, DELTA_VARINT };
+
+/**
+ * @brief Функция меняет порядок байт значения на обратный
+ * @param value Указатель на значение
+ * @param size Размер значения в байтах
+ */
+inline void swap_bytes(void *value, const size_t size) {
+    auto *bytes = static_cast<unsigned char *>(value);
+    std::reverse(bytes, bytes + size);
+}
+
+/**
+ * @brief Функция приводит заголовок, записанный с другим порядком байт, к порядку байт текущей машины
+ * @param header Заголовок файла
+ * @return true - если порядок байт файла отличается от порядка байт машины
+ */
+inline bool normalize_header(BinaryHeader &header) {
+    if (std::memcmp(header.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC)) != 0) {
+        throw std::runtime_error("Ошибка: неизвестный формат бинарного файла.");
+    }
+    if (header.endian == BINARY_ENDIAN_MARKER) {
+        return false;
+    }
+    swap_bytes(&header.endian, sizeof(header.endian));
+    if (header.endian != BINARY_ENDIAN_MARKER) {
+        throw std::runtime_error("Ошибка: повреждён маркер порядка байт.");
+    }
+    swap_bytes(&header.version, sizeof(header.version));
+    swap_bytes(&header.flags, sizeof(header.flags));
+    swap_bytes(&header.element_size, sizeof(header.element_size));
+    swap_bytes(&header.element_count, sizeof(header.element_count));
+    swap_bytes(&header.arr_size, sizeof(header.arr_size));
+    swap_bytes(&header.leaf_count, sizeof(header.leaf_count));
+    return true;
+}
+
+/**
+ * @brief Класс буферизованной записи в бинарный файл
+ * мелкие записи копируются в буфер, крупные блоки пишутся в поток напрямую, минуя буфер
+ */
+class BinaryWriter {
+    std::ofstream &ofs;
+    std::vector<char> buffer;
+    size_t used = 0;
+    uint64_t position = 0;
+
+public:
+    explicit BinaryWriter(std::ofstream &ofs, const size_t buffer_size = BINARY_BUFFER_SIZE)
+        : ofs(ofs), buffer(buffer_size) {
+    }
+
+    // деструктор дописывает остаток буфера, но не бросает исключений: он может выполняться при раскрутке стека
+    // после другой ошибки, где исключение завершило бы программу. Ошибки записи видны только из явного flush(),
+    // поэтому запись файла заканчивается вызовом flush()
+    ~BinaryWriter() noexcept {
+        try {
+            flush();
+        } catch (...) {
+        }
+    }
+
+    BinaryWriter(const BinaryWriter &) = delete;
+
+    BinaryWriter &operator=(const BinaryWriter &) = delete;
+
+    uint64_t tell() const { return position; }
+
+    void write(const void *bytes, const size_t size) {
+        if (size == 0) {
+            return;
+        }
+        if (used + size > buffer.size()) {
+            flush();
+            if (size >= buffer.size()) {
+                ofs.write(static_cast<const char *>(bytes), static_cast<std::streamsize>(size));
+                position += size;
+                return;
+            }
+        }
+        std::memcpy(buffer.data() + used, bytes, size);
+        used += size;
+        position += size;
+    }
+
+    template<typename V>
+    void write_value(const V &value) { write(&value, sizeof(V)); }
+
+    void pad(const size_t alignment = BINARY_ALIGNMENT) {
+        static constexpr char zeros[BINARY_ALIGNMENT] = {};
+        if (const size_t rest = position % alignment; rest != 0) {
+            write(zeros, alignment - rest);
+        }
+    }
+
+    void flush() {
+        if (used > 0) {
+            ofs.write(buffer.data(), static_cast<std::streamsize>(used));
+            used = 0;
+        }
+        ofs.flush();
+        if (!ofs) {
+            throw std::runtime_error("Ошибка: не удалось записать бинарный файл.");
+        }
+    }
+};
+
+/**
+ * @brief Класс буферизованного чтения из бинарного файла
+ * крупные блоки читаются из потока сразу в память назначения, минуя буфер
+ */
+class BinaryReader {
+    std::ifstream &ifs;
+    std::vector<char> buffer;
+    size_t begin = 0;
+    size_t end = 0;
+    uint64_t position = 0;
+
+    void fill() {
+        ifs.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        begin = 0;
+        end = static_cast<size_t>(ifs.gcount());
+    }
+
+public:
+    explicit BinaryReader(std::ifstream &ifs, const size_t buffer_size = BINARY_BUFFER_SIZE)
+        : ifs(ifs), buffer(buffer_size) {
+    }
+
+    BinaryReader(const BinaryReader &) = delete;
+
+    BinaryReader &operator=(const BinaryReader &) = delete;
+
+    uint64_t tell() const { return position; }
+
+    void read(void *bytes, size_t size) {
+        auto *out = static_cast<char *>(bytes);
+        position += size;
+        while (size > 0) {
+            if (begin == end) {
+                if (size >= buffer.size()) {
+                    ifs.read(out, static_cast<std::streamsize>(size));
+                    if (static_cast<size_t>(ifs.gcount()) != size) {
+                        throw std::runtime_error("Ошибка: неожиданный конец бинарного файла.");
+                    }
+                    return;
+                }
+                fill();
+                if (begin == end) {
+                    throw std::runtime_error("Ошибка: неожиданный конец бинарного файла.");
+                }
+            }
+            const size_t chunk = std::min(size, end - begin);
+            std::memcpy(out, buffer.data() + begin, chunk);
+            begin += chunk;
+            out += chunk;
+            size -= chunk;
+        }
+    }
+
+    template<typename V>
+    V read_value() {
+        V value;
+        read(&value, sizeof(V));
+        return value;
+    }
+
+    void skip_padding(const size_t alignment = BINARY_ALIGNMENT) {
+        char zeros[BINARY_ALIGNMENT];
+        if (const size_t rest = position % alignment; rest != 0) {
+            read(zeros, alignment - rest);
+        }
+    }
+};
@@ -0,0 +1,479 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "BinaryFormat.h"
+#include "Serializer.h"
+#include "Tree.h"
+
+/**
+ * Файл инкрементальных контрольных точек дерева
+ *
+ * Файл состоит из страниц по CHECKPOINT_PAGE_SIZE байт. Страницы 0 и 1 - две копии CheckpointSuperblock,
+ * которые перезаписываются по очереди (теневые страницы): новая контрольная точка дописывает сегмент страниц в
+ * конец файла, дожидается его сохранения на диске и только потом записывает суперблок в копию, не занятую
+ * текущей контрольной точкой. При сбое в любой момент одна из копий указывает на целую контрольную точку.
+ *
+ * Сегмент содержит записи вершин, выровненные на 8 байт, в обратном порядке обхода (поддеревья перед вершиной):
+ * конечная вершина - uint64_t CHECKPOINT_LEAF, uint64_t количество элементов, блок Serializer<T>;
+ * промежуточная - uint64_t CHECKPOINT_INTERMEDIATE, смещения записей левого и правого поддерева (0 - поддерева нет).
+ * Неизменённые поддеревья (TreeNode::is_stored_in) не записываются, новая запись родителя ссылается на их записи
+ * в прежних сегментах, поэтому контрольная точка пишет только изменённые вершины и путь от них до корня.
+ * Вершины помечаются записанными (TreeNode::mark_stored) только после того, как суперблок новой контрольной
+ * точки сохранён на диске: если запись сегмента или суперблока не удалась, следующая контрольная точка снова
+ * пишет эти вершины, а не ссылается на место в файле, которое будет перезаписано.
+ */
+constexpr char CHECKPOINT_MAGIC[4] = {'K', 'T', 'C', 'P'};
+constexpr size_t CHECKPOINT_PAGE_SIZE = 4096;
+constexpr uint64_t CHECKPOINT_DATA_OFFSET = 2 * CHECKPOINT_PAGE_SIZE;
+constexpr uint64_t CHECKPOINT_LEAF = 0;
+constexpr uint64_t CHECKPOINT_INTERMEDIATE = 1;
+
+/**
+ * @brief Суперблок контрольной точки
+ * root_offset - смещение записи корня (0 - пустое дерево), file_end - конец последнего сегмента,
+ * live_bytes - байты записей, достижимых из корня, checksum - FNV-1a всех предыдущих полей
+ */
+struct CheckpointSuperblock {
+    char magic[4];
+    uint16_t endian;
+    uint16_t reserved;
+    uint32_t element_size;
+    uint32_t arr_size;
+    uint64_t sequence;
+    uint64_t root_offset;
+    uint64_t file_end;
+    uint64_t live_bytes;
+    uint64_t checksum;
+};
+
+/**
+ * @brief Функция выдаёт уникальный номер открытому файлу контрольных точек, по нему вершины отличают, в какой
+ * файл они записаны
+ */
+inline uint64_t next_checkpoint_file_id() {
+    static std::atomic<uint64_t> next{1};
+    return next.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Класс файла инкрементальных контрольных точек
+ * @tparam T Тип хранимых данных
+ * @tparam arr_size Размер массива в конечной вершине
+ *
+ * save() записывает только вершины, изменённые после предыдущей записи в этот файл. Записи заменённых вершин
+ * остаются в файле мусором; когда мусор превышает живые данные, save() переписывает дерево в новый файл целиком
+ * и атомарно заменяет им старый. load() восстанавливает дерево той же формы и помечает его вершины записанными,
+ * поэтому следующая контрольная точка после загрузки снова инкрементальна.
+ */
+template<typename T, size_t arr_size>
+class CheckpointFile {
+    // запись вершины в сегменте: смещение и размер записи вместе с поддеревом
+    struct StoredRecord {
+        uint64_t offset;
+        uint64_t bytes;
+    };
+
+    std::string path;
+
+    uint64_t id = next_checkpoint_file_id();
+
+    CheckpointSuperblock current{};
+
+    uint64_t last_written = 0;
+
+    // вершины, записанные в текущий сегмент; помечаются записанными после сохранения суперблока
+    std::vector<std::pair<TreeNode<T> *, StoredRecord>> pending;
+
+    static uint64_t checksum(const CheckpointSuperblock &superblock);
+
+    static void sync(const std::string &file_path);
+
+    void create(const std::string &file_path) const;
+
+    void write_superblock(const std::string &file_path, const CheckpointSuperblock &superblock) const;
+
+    bool read_superblocks();
+
+    StoredRecord write_node(const std::shared_ptr<TreeNode<T>> &node, BinaryWriter &writer, uint64_t base);
+
+    void commit_pending();
+
+    std::shared_ptr<TreeNode<T>> read_node(std::ifstream &ifs, uint64_t offset, Tree<T, arr_size> &tree);
+
+    void write_segment(const std::string &file_path, const Tree<T, arr_size> &tree);
+
+    void compact(const Tree<T, arr_size> &tree);
+
+public:
+    explicit CheckpointFile(std::string path);
+
+    void save(const Tree<T, arr_size> &tree);
+
+    void load(Tree<T, arr_size> &tree);
+
+    uint64_t file_size() const { return current.file_end; }
+
+    uint64_t live_bytes() const { return current.live_bytes; }
+
+    uint64_t last_written_bytes() const { return last_written; }
+};
+
+/**
+ * @brief Конструктор открывает файл контрольных точек или создаёт пустой
+ * @param path Путь к файлу
+ */
+template<typename T, size_t arr_size>
+CheckpointFile<T, arr_size>::CheckpointFile(std::string path): path(std::move(path)) {
+    if (!read_superblocks()) {
+        create(this->path);
+        read_superblocks();
+    }
+    if (current.element_size != Serializer<T>::element_size || current.arr_size != arr_size) {
+        throw std::runtime_error("Ошибка: файл контрольных точек записан для другого типа дерева: " + this->path);
+    }
+}
+
+/**
+ * @brief Функция создаёт файл с пустой контрольной точкой
+ * @param file_path Путь к файлу
+ */
+template<typename T, size_t arr_size>
+void CheckpointFile<T, arr_size>::create(const std::string &file_path) const {
+    {
+        std::ofstream ofs(file_path, std::ios::binary | std::ios::trunc);
+        if (!ofs) {
+            throw std::runtime_error("Ошибка: не удалось создать файл контрольных точек: " + file_path);
+        }
+        const std::vector<char> zeros(CHECKPOINT_DATA_OFFSET);
+        ofs.write(zeros.data(), static_cast<std::streamsize>(zeros.size()));
+    }
+    CheckpointSuperblock superblock{};
+    std::memcpy(superblock.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+    superblock.endian = BINARY_ENDIAN_MARKER;
+    superblock.element_size = Serializer<T>::element_size;
+    superblock.arr_size = arr_size;
+    superblock.sequence = 1;
+    superblock.file_end = CHECKPOINT_DATA_OFFSET;
+    write_superblock(file_path, superblock);
+}
+
+/**
+ * @brief Функция читает обе копии суперблока и выбирает целую копию с наибольшим номером
+ * @return false - если файла нет или ни одна копия не прошла проверку
+ */
+template<typename T, size_t arr_size>
+bool CheckpointFile<T, arr_size>::read_superblocks() {
+    std::ifstream ifs(path, std::ios::binary);
+    if (!ifs) {
+        return false;
+    }
+    bool found = false;
+    for (size_t slot = 0; slot < 2; ++slot) {
+        CheckpointSuperblock superblock{};
+        ifs.seekg(static_cast<std::streamoff>(slot * CHECKPOINT_PAGE_SIZE));
+        if (!ifs.read(reinterpret_cast<char *>(&superblock), sizeof(superblock))) {
+            ifs.clear();
+            continue;
+        }
+        if (std::memcmp(superblock.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0 ||
+            superblock.checksum != checksum(superblock)) {
+            continue;
+        }
+        if (superblock.endian != BINARY_ENDIAN_MARKER) {
+            throw std::runtime_error("Ошибка: файл контрольных точек записан с другим порядком байт.");
+        }
+        if (!found || superblock.sequence > current.sequence) {
+            current = superblock;
+            found = true;
+        }
+    }
+    return found;
+}
+
+/**
+ * @brief Функция записывает суперблок в копию с номером sequence % 2 и дожидается его сохранения на диске
+ */
+template<typename T, size_t arr_size>
+void CheckpointFile<T, arr_size>::write_superblock(const std::string &file_path,
+                                                   const CheckpointSuperblock &superblock) const {
+    CheckpointSuperblock copy = superblock;
+    copy.checksum = checksum(copy);
+    const int file = ::open(file_path.c_str(), O_WRONLY);
+    if (file < 0) {
+        throw std::runtime_error("Ошибка: не удалось открыть файл контрольных точек: " + file_path);
+    }
+    const auto offset = static_cast<off_t>((copy.sequence % 2) * CHECKPOINT_PAGE_SIZE);
+    const bool written = ::pwrite(file, &copy, sizeof(copy), offset) == static_cast<ssize_t>(sizeof(copy));
+    ::close(file);
+    if (!written) {
+        throw std::runtime_error("Ошибка: не удалось записать суперблок: " + file_path);
+    }
+    sync(file_path);
+}
+
+/**
+ * @brief Функция сохраняет контрольную точку дерева, записывая только изменённые вершины
+ * @param tree Дерево
+ */
+template<typename T, size_t arr_size>
+void CheckpointFile<T, arr_size>::save(const Tree<T, arr_size> &tree) {
+    const uint64_t data_bytes = current.file_end - CHECKPOINT_DATA_OFFSET;
+    if (data_bytes > (1u << 20) && current.live_bytes < data_bytes / 2) {
+        compact(tree);
+        return;
+    }
+    write_segment(path, tree);
+    commit_pending();
+}
+
+/**
+ * @brief Функция помечает вершины сегмента записанными, вызывается после сохранения суперблока
+ */
+template<typename T, size_t arr_size>
+void CheckpointFile<T, arr_size>::commit_pending() {
+    for (const auto &[node, record]: pending) {
+        node->mark_stored(id, record.offset, record.bytes);
+    }
+    pending.clear();
+}
+
+/**
+ * @brief Функция дописывает в файл сегмент с изменёнными вершинами и публикует его новым суперблоком
+ * @param file_path Путь к файлу
+ * @param tree Дерево
+ */
+template<typename T, size_t arr_size>
+void CheckpointFile<T, arr_size>::write_segment(const std::string &file_path, const Tree<T, arr_size> &tree) {
+    const uint64_t base = current.file_end;
+    StoredRecord root_record{0, 0};
+    uint64_t segment_end = base;
+    pending.clear();
+    {
+        std::ofstream ofs(file_path, std::ios::binary | std::ios::in | std::ios::out);
+        if (!ofs) {
+            throw std::runtime_error("Ошибка: не удалось открыть файл контрольных точек: " + file_path);
+        }
+        ofs.seekp(static_cast<std::streamoff>(base));
+        BinaryWriter writer(ofs);
+        root_record = write_node(tree.root, writer, base);
+        if (const size_t rest = writer.tell() % CHECKPOINT_PAGE_SIZE; rest != 0) {
+            const std::vector<char> zeros(CHECKPOINT_PAGE_SIZE - rest);
+            writer.write(zeros.data(), zeros.size());
+        }
+        writer.flush();
+        last_written = writer.tell();
+        segment_end = base + writer.tell();
+    }
+    sync(file_path);
+
+    CheckpointSuperblock next = current;
+    next.sequence = current.sequence + 1;
+    next.root_offset = root_record.offset;
+    next.file_end = segment_end;
+    next.live_bytes = root_record.bytes;
+    write_superblock(file_path, next);
+    current = next;
+}
+
+/**
+ * @brief Функция переписывает дерево целиком в новый файл и атомарно заменяет им старый
+ * новый номер файла делает все вершины незаписанными в него, поэтому сегмент содержит всё дерево
+ * @param tree Дерево
+ */
+template<typename T, size_t arr_size>
+void CheckpointFile<T, arr_size>::compact(const Tree<T, arr_size> &tree) {
+    const std::string temporary = path + ".tmp";
+    create(temporary);
+    const CheckpointSuperblock previous = current;
+    const uint64_t previous_id = id;
+
+    current = CheckpointSuperblock{};
+    std::memcpy(current.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+    current.endian = BINARY_ENDIAN_MARKER;
+    current.element_size = Serializer<T>::element_size;
+    current.arr_size = arr_size;
+    current.sequence = 1;
+    current.file_end = CHECKPOINT_DATA_OFFSET;
+    id = next_checkpoint_file_id();
+    try {
+        write_segment(temporary, tree);
+        if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+            throw std::runtime_error("Ошибка: не удалось заменить файл контрольных точек: " + path);
+        }
+    } catch (...) {
+        current = previous;
+        id = previous_id;
+        pending.clear();
+        std::remove(temporary.c_str());
+        throw;
+    }
+    commit_pending();
+    const size_t slash = path.find_last_of('/');
+    sync(slash == std::string::npos ? "." : path.substr(0, slash + 1));
+}
+
+/**
+ * @brief Функция записывает изменённые вершины поддерева, поддеревья раньше родителя, и добавляет их в pending
+ * @param node Вершина
+ * @param writer Запись в конец файла
+ * @param base Смещение начала сегмента в файле
+ * @return Смещение записи вершины (0 для пустого поддерева) и размер записей поддерева
+ */
+template<typename T, size_t arr_size>
+typename CheckpointFile<T, arr_size>::StoredRecord CheckpointFile<T, arr_size>::write_node(
+    const std::shared_ptr<TreeNode<T>> &node, BinaryWriter &writer, const uint64_t base) {
+    if (!node) {
+        return {0, 0};
+    }
+    if (node->is_stored_in(id)) {
+        return {node->get_stored_offset(), node->get_stored_bytes()};
+    }
+
+    if (node->get_type() == TYPE::LEAF) {
+        auto leaf = std::static_pointer_cast<LeafNode<T, arr_size>>(node);
+        const uint64_t offset = base + writer.tell();
+        writer.write_value(CHECKPOINT_LEAF);
+        writer.write_value(static_cast<uint64_t>(leaf->get_size()));
+        leaf->write_block(writer);
+        writer.pad();
+        const StoredRecord record{offset, base + writer.tell() - offset};
+        pending.emplace_back(node.get(), record);
+        return record;
+    }
+
+    auto intermediate = std::static_pointer_cast<IntermediateNode<T, arr_size>>(node);
+    const StoredRecord left = write_node(intermediate->get_left_node(), writer, base);
+    const StoredRecord right = write_node(intermediate->get_right_node(), writer, base);
+    const uint64_t offset = base + writer.tell();
+    writer.write_value(CHECKPOINT_INTERMEDIATE);
+    writer.write_value(left.offset);
+    writer.write_value(right.offset);
+
+    const StoredRecord record{offset, 3 * sizeof(uint64_t) + left.bytes + right.bytes};
+    pending.emplace_back(node.get(), record);
+    return record;
+}
+
+/**
+ * @brief Функция загружает последнюю целую контрольную точку
+ * @param tree Дерево, содержимое которого заменяется загруженным
+ */
+template<typename T, size_t arr_size>
+void CheckpointFile<T, arr_size>::load(Tree<T, arr_size> &tree) {
+    std::ifstream ifs(path, std::ios::binary);
+    if (!ifs) {
+        throw std::runtime_error("Ошибка: файл не удалось открыть для чтения: " + path);
+    }
+    tree.clear();
+    tree.root = read_node(ifs, current.root_offset, tree);
+    tree.isTreeSorted = false;
+}
+
+/**
+ * @brief Функция читает запись вершины и её поддеревьев
+ * @param ifs Поток файла
+ * @param offset Смещение записи, 0 - пустое поддерево
+ * @param tree Дерево, в область памяти которого читаются строки std::string_view
+ */
+template<typename T, size_t arr_size>
+std::shared_ptr<TreeNode<T>> CheckpointFile<T, arr_size>::read_node(std::ifstream &ifs, const uint64_t offset,
+                                                                    Tree<T, arr_size> &tree) {
+    if (offset == 0) {
+        return nullptr;
+    }
+    if (offset < CHECKPOINT_DATA_OFFSET || offset >= current.file_end || offset % BINARY_ALIGNMENT != 0) {
+        throw std::runtime_error("Ошибка: повреждён файл контрольных точек.");
+    }
+
+    ifs.seekg(static_cast<std::streamoff>(offset));
+    BinaryReader reader(ifs, 0);
+    const auto type = reader.read_value<uint64_t>();
+
+    if (type == CHECKPOINT_LEAF) {
+        const auto leaf_size = reader.read_value<uint64_t>();
+        if (leaf_size > arr_size) {
+            throw std::runtime_error("Ошибка: повреждён файл контрольных точек.");
+        }
+        auto leaf = tree.make_leaf();
+        if constexpr (std::is_same_v<T, std::string>) {
+            leaf->read_block(reader, leaf_size, false);
+        } else {
+            std::vector<T> block(leaf_size);
+            Serializer<T>::read_block(reader, block.data(), block.size(), false, tree.get_arena());
+            leaf->assign(std::make_move_iterator(block.begin()), block.size());
+        }
+        reader.skip_padding();
+        leaf->mark_stored(id, offset, reader.tell());
+        return leaf;
+    }
+
+    if (type != CHECKPOINT_INTERMEDIATE) {
+        throw std::runtime_error("Ошибка: повреждён файл контрольных точек.");
+    }
+    const auto left_offset = reader.read_value<uint64_t>();
+    const auto right_offset = reader.read_value<uint64_t>();
+    // поддеревья всегда записаны раньше родителя, иначе файл повреждён (и мог бы зациклить чтение)
+    if (left_offset >= offset || right_offset >= offset) {
+        throw std::runtime_error("Ошибка: повреждён файл контрольных точек.");
+    }
+
+    auto intermediate = std::make_shared<IntermediateNode<T, arr_size>>();
+    intermediate->set_left_node(read_node(ifs, left_offset, tree));
+    intermediate->set_right_node(read_node(ifs, right_offset, tree));
+
+    uint64_t bytes = 3 * sizeof(uint64_t);
+    for (const auto &child: {intermediate->get_left_node(), intermediate->get_right_node()}) {
+        if (child) {
+            bytes += child->get_stored_bytes();
+        }
+    }
+    intermediate->mark_stored(id, offset, bytes);
+    return intermediate;
+}
+
+/**
+ * @brief Функция дожидается сохранения файла или каталога на диске
+ * на macOS fsync не сбрасывает кэш накопителя, для этого нужен F_FULLFSYNC
+ */
+template<typename T, size_t arr_size>
+void CheckpointFile<T, arr_size>::sync(const std::string &file_path) {
+    const int file = ::open(file_path.c_str(), O_RDONLY);
+    if (file < 0) {
+        throw std::runtime_error("Ошибка: не удалось открыть файл для синхронизации: " + file_path);
+    }
+#ifdef F_FULLFSYNC
+    if (::fcntl(file, F_FULLFSYNC) == 0) {
+        ::close(file);
+        return;
+    }
+#endif
+    const bool synced = ::fsync(file) == 0;
+    ::close(file);
+    if (!synced) {
+        throw std::runtime_error("Ошибка: не удалось сохранить файл на диск: " + file_path);
+    }
+}
+
+/**
+ * @brief Функция считает контрольную сумму FNV-1a суперблока без поля checksum
+ */
+template<typename T, size_t arr_size>
+uint64_t CheckpointFile<T, arr_size>::checksum(const CheckpointSuperblock &superblock) {
+    const auto *bytes = reinterpret_cast<const unsigned char *>(&superblock);
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < offsetof(CheckpointSuperblock, checksum); ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
@@ -0,0 +1,184 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "Tree.h"
+
+/**
+ * @brief Класс дерева для конкурентного доступа: много читателей и один писатель
+ * @tparam T Тип хранимых данных
+ * @tparam arr_size Размер массива в конечной вершине
+ *
+ * Читатели не берут writer_mutex и работают с опубликованной версией дерева, которая атомарно загружается из
+ * current. Писатель под writer_mutex строит новую версию на копии дерева и атомарно публикует её, поэтому долгие
+ * сортировки и загрузки не задерживают читателей. Копия разделяет вершины с опубликованной версией (копирование
+ * при записи, см. Tree), поэтому изменение копирует только вершины на пути от корня к изменённой вершине.
+ *
+ * Атомарные операции над std::shared_ptr (std::atomic_load_explicit, std::atomic_exchange_explicit) в libstdc++
+ * и libc++ не свободны от блокировок: копирование указателя защищается внутренней блокировкой из общего пула.
+ * Она удерживается только на время копирования указателя, поэтому читатели не ждут изменений писателя, но
+ * snapshot() не является lock-free в строгом смысле.
+ *
+ * Старые версии не удаляются сразу: писатель складывает их в retired и освобождает только тогда, когда на них
+ * не осталось ссылок читателей, поэтому стоимость освобождения вершин не ложится на потоки-читатели.
+ */
+template<typename T, size_t arr_size>
+class ConcurrentTree {
+    using Version = Tree<T, arr_size>;
+
+    std::shared_ptr<const Version> current;
+
+    std::mutex writer_mutex;
+
+    std::vector<std::shared_ptr<const Version> > retired;
+
+    void publish(std::shared_ptr<const Version> version);
+
+    void collect_retired();
+
+public:
+    ConcurrentTree(): current(std::make_shared<const Version>()) {
+    }
+
+    ConcurrentTree(const ConcurrentTree &) = delete;
+
+    ConcurrentTree &operator=(const ConcurrentTree &) = delete;
+
+    std::shared_ptr<const Version> snapshot() const;
+
+    T get_by_index(size_t index) const { return snapshot()->get_by_index(index); }
+
+    size_t size() const { return snapshot()->size(); }
+
+    void for_each(const std::function<void(const T &)> &func) const { snapshot()->for_each(func); }
+
+    template<typename Func>
+    void write(Func &&mutation);
+
+    bool insert(const T &element);
+
+    bool remove(const T &element);
+
+    bool insert_by_index(size_t index, const T &element);
+
+    bool remove_by_index(size_t index);
+
+    bool sort();
+
+    void clear();
+
+    void load_from_binary_file(std::ifstream &ifs);
+};
+
+/**
+ * @brief Функция возвращает текущую опубликованную версию дерева
+ * версия неизменяема и остаётся корректной, пока читатель удерживает указатель, даже если писатель уже
+ * опубликовал новую
+ * @return Указатель на версию дерева
+ */
+template<typename T, size_t arr_size>
+std::shared_ptr<const Tree<T, arr_size> > ConcurrentTree<T, arr_size>::snapshot() const {
+    return std::atomic_load_explicit(&current, std::memory_order_acquire);
+}
+
+/**
+ * @brief Функция для изменения дерева писателем
+ * изменения применяются к копии текущей версии, разделяющей с ней вершины, и становятся видны читателям одной
+ * атомарной публикацией. Вставка и удаление копируют вершины на пути от корня к изменённой вершине, то есть
+ * height() вершин: O(log n) для дерева, построенного balance(), append() или загрузкой из файла, но Tree::insert
+ * не балансирует дерево, и после последовательных вставок путь растёт линейно (5000 вставок по возрастанию дают
+ * высоту около 2n / arr_size). Такое дерево стоит сбалансировать внутри той же mutation. Изменения всех вершин
+ * (sort) копируют все затронутые вершины, поэтому несколько изменений выгодно объединять в один вызов
+ * @param mutation Функция, получающая ссылку на новую версию дерева
+ */
+template<typename T, size_t arr_size>
+template<typename Func>
+void ConcurrentTree<T, arr_size>::write(Func &&mutation) {
+    std::lock_guard<std::mutex> lock(writer_mutex);
+    auto version = std::make_shared<Version>(*std::atomic_load_explicit(&current, std::memory_order_relaxed));
+    mutation(*version);
+    publish(std::move(version));
+}
+
+/**
+ * @brief Функция атомарно публикует новую версию, вызывается только под writer_mutex
+ * @param version Новая версия дерева
+ */
+template<typename T, size_t arr_size>
+void ConcurrentTree<T, arr_size>::publish(std::shared_ptr<const Version> version) {
+    retired.push_back(std::atomic_exchange_explicit(&current, std::move(version), std::memory_order_acq_rel));
+    collect_retired();
+}
+
+/**
+ * @brief Функция освобождает старые версии, которые больше не используются читателями
+ * снятая с публикации версия не может быть получена заново, поэтому единственная оставшаяся ссылка из
+ * retired означает, что читателей у неё нет
+ */
+template<typename T, size_t arr_size>
+void ConcurrentTree<T, arr_size>::collect_retired() {
+    retired.erase(std::remove_if(retired.begin(), retired.end(),
+                                 [](const std::shared_ptr<const Version> &version) {
+                                     return version.use_count() == 1;
+                                 }),
+                  retired.end());
+}
+
+template<typename T, size_t arr_size>
+bool ConcurrentTree<T, arr_size>::insert(const T &element) {
+    bool result = false;
+    write([&](Version &tree) { result = tree.insert(element); });
+    return result;
+}
+
+template<typename T, size_t arr_size>
+bool ConcurrentTree<T, arr_size>::remove(const T &element) {
+    bool result = false;
+    write([&](Version &tree) { result = tree.remove(element); });
+    return result;
+}
+
+template<typename T, size_t arr_size>
+bool ConcurrentTree<T, arr_size>::insert_by_index(const size_t index, const T &element) {
+    bool result = false;
+    write([&](Version &tree) { result = tree.insert_by_index(index, element); });
+    return result;
+}
+
+template<typename T, size_t arr_size>
+bool ConcurrentTree<T, arr_size>::remove_by_index(const size_t index) {
+    bool result = false;
+    write([&](Version &tree) { result = tree.remove_by_index(index); });
+    return result;
+}
+
+template<typename T, size_t arr_size>
+bool ConcurrentTree<T, arr_size>::sort() {
+    bool result = false;
+    write([&](Version &tree) { result = tree.sort(); });
+    return result;
+}
+
+/**
+ * @brief Функция очищает дерево, публикуя пустую версию без копирования текущей
+ */
+template<typename T, size_t arr_size>
+void ConcurrentTree<T, arr_size>::clear() {
+    std::lock_guard<std::mutex> lock(writer_mutex);
+    publish(std::make_shared<const Version>());
+}
+
+/**
+ * @brief Функция загружает дерево из бинарного файла в новую версию, читатели продолжают работать со старой
+ * @param ifs Поток входных данных
+ */
+template<typename T, size_t arr_size>
+void ConcurrentTree<T, arr_size>::load_from_binary_file(std::ifstream &ifs) {
+    auto version = std::make_shared<Version>();
+    version->load_from_binary_file(ifs);
+    std::lock_guard<std::mutex> lock(writer_mutex);
+    publish(std::move(version));
+}
@@ -0,0 +1,322 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+/**
+ * Сжатие блока целых чисел для бинарного формата (флаг BINARY_FLAG_DELTA_VARINT)
+ *
+ * Каждый элемент заменяется разностью с предыдущим (первый - разностью с нулём), разность отображается в
+ * беззнаковое число zigzag-кодированием (0, -1, 1, -2, ... -> 0, 1, 2, 3, ...) и записывается varint: по 7 бит
+ * в байте, старший бит байта означает продолжение. После Tree::sort соседние элементы близки, поэтому большинство
+ * разностей занимает один байт вместо sizeof(T).
+ *
+ * Байты varint не зависят от порядка байт машины. Каждая конечная вершина кодируется отдельно, поэтому вершины
+ * декодируются независимо друг от друга
+ */
+template<typename T>
+constexpr bool is_delta_encodable_v = std::is_integral_v<T> && !std::is_same_v<T, bool> && sizeof(T) <= 8;
+
+/**
+ * @brief Функция кодирует блок элементов
+ * @param elements Элементы
+ * @param count Количество элементов
+ * @param out Буфер, в конец которого дописываются закодированные байты
+ */
+template<typename T>
+void delta_encode(const T *elements, const size_t count, std::vector<uint8_t> &out) {
+    static_assert(is_delta_encodable_v<T>, "delta encoding requires an integral type");
+    using U = std::make_unsigned_t<T>;
+    using S = std::make_signed_t<T>;
+
+    U previous = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const auto value = static_cast<U>(elements[i]);
+        const auto delta = static_cast<S>(static_cast<U>(value - previous));
+        previous = value;
+
+        uint64_t zigzag = (static_cast<uint64_t>(static_cast<U>(delta)) << 1) ^
+                          static_cast<uint64_t>(static_cast<U>(delta >> (sizeof(T) * 8 - 1)));
+        zigzag &= sizeof(T) == 8 ? UINT64_MAX : (uint64_t{1} << (sizeof(T) * 8)) - 1;
+        while (zigzag >= 0x80) {
+            out.push_back(static_cast<uint8_t>(zigzag | 0x80));
+            zigzag >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(zigzag));
+    }
+}
+
+#if defined(__SSE2__)
+/**
+ * @brief Функции работы с регистром SSE2 как с массивом чисел ширины W байт
+ */
+template<size_t W>
+__m128i delta_lanes_add(const __m128i left, const __m128i right) {
+    if constexpr (W == 1) {
+        return _mm_add_epi8(left, right);
+    } else if constexpr (W == 2) {
+        return _mm_add_epi16(left, right);
+    } else if constexpr (W == 4) {
+        return _mm_add_epi32(left, right);
+    } else {
+        return _mm_add_epi64(left, right);
+    }
+}
+
+template<size_t W>
+__m128i delta_lanes_set(const uint64_t value) {
+    if constexpr (W == 1) {
+        return _mm_set1_epi8(static_cast<char>(value));
+    } else if constexpr (W == 2) {
+        return _mm_set1_epi16(static_cast<short>(value));
+    } else if constexpr (W == 4) {
+        return _mm_set1_epi32(static_cast<int>(value));
+    } else {
+        return _mm_set1_epi64x(static_cast<long long>(value));
+    }
+}
+
+/**
+ * @brief Функция считает префиксные суммы чисел регистра: сдвиги на 1, 2, 4 ... числа и сложения
+ */
+template<size_t W>
+__m128i delta_lanes_prefix_sum(__m128i lanes) {
+    if constexpr (W <= 1) {
+        lanes = delta_lanes_add<W>(lanes, _mm_slli_si128(lanes, 1));
+    }
+    if constexpr (W <= 2) {
+        lanes = delta_lanes_add<W>(lanes, _mm_slli_si128(lanes, 2));
+    }
+    if constexpr (W <= 4) {
+        lanes = delta_lanes_add<W>(lanes, _mm_slli_si128(lanes, 4));
+    }
+    return delta_lanes_add<W>(lanes, _mm_slli_si128(lanes, 8));
+}
+
+/**
+ * @brief Функция расширяет числа со знаком ширины W байт до 2W байт: младшая и старшая половины регистра
+ */
+template<size_t W>
+void delta_lanes_widen(const __m128i lanes, __m128i &low, __m128i &high) {
+    __m128i sign;
+    if constexpr (W == 1) {
+        sign = _mm_cmpgt_epi8(_mm_setzero_si128(), lanes);
+        low = _mm_unpacklo_epi8(lanes, sign);
+        high = _mm_unpackhi_epi8(lanes, sign);
+    } else if constexpr (W == 2) {
+        sign = _mm_cmpgt_epi16(_mm_setzero_si128(), lanes);
+        low = _mm_unpacklo_epi16(lanes, sign);
+        high = _mm_unpackhi_epi16(lanes, sign);
+    } else {
+        sign = _mm_cmpgt_epi32(_mm_setzero_si128(), lanes);
+        low = _mm_unpacklo_epi32(lanes, sign);
+        high = _mm_unpackhi_epi32(lanes, sign);
+    }
+}
+
+/**
+ * @brief Функция расширяет 16 разностей со знаком из байт до ширины W
+ * @param deltas Разности по байту
+ * @param out W регистров с разностями в порядке следования
+ */
+template<size_t W>
+void delta_widen(const __m128i deltas, __m128i *out) {
+    if constexpr (W == 1) {
+        out[0] = deltas;
+    } else {
+        __m128i half[W / 2];
+        delta_widen<W / 2>(deltas, half);
+        for (size_t i = 0; i < W / 2; ++i) {
+            delta_lanes_widen<W / 2>(half[i], out[2 * i], out[2 * i + 1]);
+        }
+    }
+}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+/**
+ * @brief Функции работы с регистром NEON как с массивом чисел ширины W байт
+ */
+template<size_t W>
+int8x16_t delta_lanes_add(const int8x16_t left, const int8x16_t right) {
+    if constexpr (W == 1) {
+        return vaddq_s8(left, right);
+    } else if constexpr (W == 2) {
+        return vreinterpretq_s8_s16(vaddq_s16(vreinterpretq_s16_s8(left), vreinterpretq_s16_s8(right)));
+    } else if constexpr (W == 4) {
+        return vreinterpretq_s8_s32(vaddq_s32(vreinterpretq_s32_s8(left), vreinterpretq_s32_s8(right)));
+    } else {
+        return vreinterpretq_s8_s64(vaddq_s64(vreinterpretq_s64_s8(left), vreinterpretq_s64_s8(right)));
+    }
+}
+
+template<size_t W>
+int8x16_t delta_lanes_set(const uint64_t value) {
+    if constexpr (W == 1) {
+        return vdupq_n_s8(static_cast<int8_t>(value));
+    } else if constexpr (W == 2) {
+        return vreinterpretq_s8_s16(vdupq_n_s16(static_cast<int16_t>(value)));
+    } else if constexpr (W == 4) {
+        return vreinterpretq_s8_s32(vdupq_n_s32(static_cast<int32_t>(value)));
+    } else {
+        return vreinterpretq_s8_s64(vdupq_n_s64(static_cast<int64_t>(value)));
+    }
+}
+
+/**
+ * @brief Функция считает префиксные суммы чисел регистра: сдвиги на 1, 2, 4 ... числа (vextq с нулями) и сложения
+ */
+template<size_t W>
+int8x16_t delta_lanes_prefix_sum(int8x16_t lanes) {
+    const int8x16_t zero = vdupq_n_s8(0);
+    if constexpr (W <= 1) {
+        lanes = delta_lanes_add<W>(lanes, vextq_s8(zero, lanes, 15));
+    }
+    if constexpr (W <= 2) {
+        lanes = delta_lanes_add<W>(lanes, vextq_s8(zero, lanes, 14));
+    }
+    if constexpr (W <= 4) {
+        lanes = delta_lanes_add<W>(lanes, vextq_s8(zero, lanes, 12));
+    }
+    return delta_lanes_add<W>(lanes, vextq_s8(zero, lanes, 8));
+}
+
+/**
+ * @brief Функция расширяет 16 разностей со знаком из байт до ширины W
+ * @param deltas Разности по байту
+ * @param out W регистров с разностями в порядке следования
+ */
+template<size_t W>
+void delta_widen(const int8x16_t deltas, int8x16_t *out) {
+    if constexpr (W == 1) {
+        out[0] = deltas;
+    } else {
+        int8x16_t half[W / 2];
+        delta_widen<W / 2>(deltas, half);
+        for (size_t i = 0; i < W / 2; ++i) {
+            if constexpr (W == 2) {
+                out[2 * i] = vreinterpretq_s8_s16(vmovl_s8(vget_low_s8(half[i])));
+                out[2 * i + 1] = vreinterpretq_s8_s16(vmovl_s8(vget_high_s8(half[i])));
+            } else if constexpr (W == 4) {
+                const int16x8_t lanes = vreinterpretq_s16_s8(half[i]);
+                out[2 * i] = vreinterpretq_s8_s32(vmovl_s16(vget_low_s16(lanes)));
+                out[2 * i + 1] = vreinterpretq_s8_s32(vmovl_s16(vget_high_s16(lanes)));
+            } else {
+                const int32x4_t lanes = vreinterpretq_s32_s8(half[i]);
+                out[2 * i] = vreinterpretq_s8_s64(vmovl_s32(vget_low_s32(lanes)));
+                out[2 * i + 1] = vreinterpretq_s8_s64(vmovl_s32(vget_high_s32(lanes)));
+            }
+        }
+    }
+}
+#endif
+
+#if defined(__SSE2__) || (defined(__ARM_NEON) && defined(__aarch64__))
+/**
+ * @brief Функция декодирует 16 однобайтовых разностей
+ * Разности разбираются из zigzag во всех 16 байтах сразу, расширяются до ширины T и складываются префиксными
+ * суммами внутри регистров; последний элемент каждого регистра добавляется ко всем числам следующего
+ * @param bytes 16 закодированных байт без битов продолжения
+ * @param previous Последний декодированный элемент, после вызова - последний из 16 новых
+ * @param elements Массив для 16 элементов
+ */
+template<typename T>
+void delta_decode_run(const uint8_t *bytes, std::make_unsigned_t<T> &previous, T *elements) {
+    constexpr size_t W = sizeof(T);
+    constexpr size_t lanes_per_register = 16 / W;
+#if defined(__SSE2__)
+    const __m128i raw = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes));
+    const __m128i half = _mm_and_si128(_mm_srli_epi16(raw, 1), _mm_set1_epi8(0x3F));
+    const __m128i sign = _mm_sub_epi8(_mm_setzero_si128(), _mm_and_si128(raw, _mm_set1_epi8(1)));
+    __m128i registers[W];
+    delta_widen<W>(_mm_xor_si128(half, sign), registers);
+    for (size_t i = 0; i < W; ++i) {
+        const __m128i sums = delta_lanes_add<W>(delta_lanes_prefix_sum<W>(registers[i]), delta_lanes_set<W>(previous));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(elements + i * lanes_per_register), sums);
+        previous = static_cast<std::make_unsigned_t<T>>(elements[(i + 1) * lanes_per_register - 1]);
+    }
+#else
+    const uint8x16_t raw = vld1q_u8(bytes);
+    const int8x16_t half = vreinterpretq_s8_u8(vshrq_n_u8(raw, 1));
+    const int8x16_t sign = vnegq_s8(vreinterpretq_s8_u8(vandq_u8(raw, vdupq_n_u8(1))));
+    int8x16_t registers[W];
+    delta_widen<W>(veorq_s8(half, sign), registers);
+    for (size_t i = 0; i < W; ++i) {
+        const int8x16_t sums = delta_lanes_add<W>(delta_lanes_prefix_sum<W>(registers[i]), delta_lanes_set<W>(previous));
+        vst1q_s8(reinterpret_cast<int8_t *>(elements + i * lanes_per_register), sums);
+        previous = static_cast<std::make_unsigned_t<T>>(elements[(i + 1) * lanes_per_register - 1]);
+    }
+#endif
+}
+
+/**
+ * @brief Функция возвращает маску битов продолжения 16 байт: бит i установлен, если у bytes[i] старший бит равен 1
+ */
+inline uint32_t delta_continuation_mask(const uint8_t *bytes) {
+#if defined(__SSE2__)
+    return static_cast<uint32_t>(_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes))));
+#else
+    // у NEON нет movemask: каждый байт оставляет свой бит, и биты половин складываются
+    static constexpr uint8_t weights[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    const uint8x16_t bits = vandq_u8(vcltq_s8(vreinterpretq_s8_u8(vld1q_u8(bytes)), vdupq_n_s8(0)), vld1q_u8(weights));
+    return vaddv_u8(vget_low_u8(bits)) | static_cast<uint32_t>(vaddv_u8(vget_high_u8(bits))) << 8;
+#endif
+}
+#endif
+
+/**
+ * @brief Функция декодирует блок элементов
+ * На SSE2 и NEON маска битов продолжения 16 байт находится одной командой; если в окне нет многобайтовых
+ * разностей, 16 элементов декодируются в регистрах вместе с префиксными суммами (см. delta_decode_run). Иначе
+ * по байтам разбирается одна разность, и проверка окна повторяется со следующей. На остальных платформах все
+ * разности разбираются по байтам
+ * @param bytes Закодированные байты
+ * @param size Количество закодированных байт
+ * @param elements Массив для count элементов
+ * @param count Количество элементов
+ */
+template<typename T>
+void delta_decode(const uint8_t *bytes, const size_t size, T *elements, const size_t count) {
+    static_assert(is_delta_encodable_v<T>, "delta encoding requires an integral type");
+    using U = std::make_unsigned_t<T>;
+
+    const uint8_t *position = bytes;
+    const uint8_t *const end = bytes + size;
+    U previous = 0;
+    size_t i = 0;
+
+    while (i < count) {
+#if defined(__SSE2__) || (defined(__ARM_NEON) && defined(__aarch64__))
+        if (count - i >= 16 && end - position >= 16 && delta_continuation_mask(position) == 0) {
+            delta_decode_run(position, previous, elements + i);
+            position += 16;
+            i += 16;
+            continue;
+        }
+#endif
+
+        uint64_t zigzag = 0;
+        for (int shift = 0;; shift += 7) {
+            if (position == end || shift > 63) {
+                throw std::runtime_error("Ошибка: повреждён сжатый блок в бинарном файле.");
+            }
+            const uint8_t byte = *position++;
+            zigzag |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                break;
+            }
+        }
+        previous += static_cast<U>((zigzag >> 1) ^ (~(zigzag & 1) + 1));
+        elements[i++] = static_cast<T>(previous);
+    }
+
+    if (position != end) {
+        throw std::runtime_error("Ошибка: повреждён сжатый блок в бинарном файле.");
+    }
+}
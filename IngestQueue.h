@@ -0,0 +1,194 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Tree.h"
+
+/**
+ * @brief Класс асинхронной загрузки элементов в дерево
+ * @tparam T Тип хранимых данных
+ * @tparam arr_size Размер массива в конечной вершине
+ *
+ * Производители добавляют элементы в неблокирующую очередь (много производителей - один потребитель), поэтому
+ * добавление стоит одну атомарную операцию. Отдельный поток-писатель забирает элементы пачками до batch_size
+ * и добавляет их в дерево одной операцией Tree::append. Читатели работают с деревом через read(), а flush()
+ * дожидается применения всех элементов, добавленных до его вызова.
+ */
+template<typename T, size_t arr_size>
+class IngestQueue {
+    struct Item {
+        T value{};
+        std::atomic<Item *> next{nullptr};
+    };
+
+    std::atomic<Item *> head;
+
+    Item *tail;
+
+    Tree<T, arr_size> &tree;
+
+    mutable std::mutex tree_mutex;
+
+    const size_t batch_size;
+
+    std::atomic<size_t> pushed{0};
+
+    std::atomic<size_t> applied{0};
+
+    std::atomic<bool> running{true};
+
+    std::atomic<bool> writer_sleeping{false};
+
+    std::mutex wake_mutex;
+
+    std::condition_variable wake;
+
+    std::mutex flush_mutex;
+
+    std::condition_variable flushed;
+
+    std::thread writer;
+
+    bool pop(T &value);
+
+    void writer_loop();
+
+public:
+    explicit IngestQueue(Tree<T, arr_size> &tree, size_t batch_size = 4096);
+
+    ~IngestQueue();
+
+    IngestQueue(const IngestQueue &) = delete;
+
+    IngestQueue &operator=(const IngestQueue &) = delete;
+
+    void push(T element);
+
+    void flush();
+
+    void read(const std::function<void(const Tree<T, arr_size> &)> &func) const;
+};
+
+template<typename T, size_t arr_size>
+IngestQueue<T, arr_size>::IngestQueue(Tree<T, arr_size> &tree, const size_t batch_size)
+    : tail(new Item()), tree(tree), batch_size(batch_size == 0 ? 1 : batch_size) {
+    head.store(tail, std::memory_order_relaxed);
+    writer = std::thread(&IngestQueue::writer_loop, this);
+}
+
+/**
+ * @brief Деструктор останавливает поток-писатель после применения всех добавленных элементов
+ */
+template<typename T, size_t arr_size>
+IngestQueue<T, arr_size>::~IngestQueue() {
+    running.store(false, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+    }
+    wake.notify_one();
+    writer.join();
+    delete tail;
+}
+
+/**
+ * @brief Функция добавляет элемент в очередь, не блокируя производителя
+ * @param element Элемент который необходимо добавить
+ */
+template<typename T, size_t arr_size>
+void IngestQueue<T, arr_size>::push(T element) {
+    auto *item = new Item();
+    item->value = std::move(element);
+    // счётчик увеличивается до вставки в очередь: flush() другого производителя, чей элемент встал в очередь
+    // позже, учитывает и этот элемент, даже если он ещё не связан
+    pushed.fetch_add(1, std::memory_order_acq_rel);
+    Item *previous = head.exchange(item, std::memory_order_acq_rel);
+    previous->next.store(item, std::memory_order_release);
+
+    if (writer_sleeping.load(std::memory_order_acquire)) {
+        wake.notify_one();
+    }
+}
+
+/**
+ * @brief Функция извлекает элемент из очереди, вызывается только потоком-писателем
+ * @param value Извлечённый элемент
+ * @return true - если элемент извлечён
+ * @return false - если очередь пуста или следующий элемент ещё не связан производителем
+ */
+template<typename T, size_t arr_size>
+bool IngestQueue<T, arr_size>::pop(T &value) {
+    Item *next = tail->next.load(std::memory_order_acquire);
+    if (!next) {
+        return false;
+    }
+    value = std::move(next->value);
+    delete tail;
+    tail = next;
+    return true;
+}
+
+/**
+ * @brief Основной цикл потока-писателя: собирает пачку элементов и добавляет её в дерево
+ */
+template<typename T, size_t arr_size>
+void IngestQueue<T, arr_size>::writer_loop() {
+    std::vector<T> batch;
+    batch.reserve(batch_size);
+
+    while (true) {
+        T value;
+        while (batch.size() < batch_size && pop(value)) {
+            batch.push_back(std::move(value));
+        }
+
+        if (batch.empty()) {
+            if (!running.load(std::memory_order_acquire) &&
+                applied.load(std::memory_order_relaxed) == pushed.load(std::memory_order_acquire)) {
+                return;
+            }
+            std::unique_lock<std::mutex> lock(wake_mutex);
+            writer_sleeping.store(true, std::memory_order_release);
+            wake.wait_for(lock, std::chrono::milliseconds(1));
+            writer_sleeping.store(false, std::memory_order_release);
+            continue;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(tree_mutex);
+            tree.append(batch);
+        }
+        applied.fetch_add(batch.size(), std::memory_order_release);
+        batch.clear();
+
+        {
+            std::lock_guard<std::mutex> lock(flush_mutex);
+        }
+        flushed.notify_all();
+    }
+}
+
+/**
+ * @brief Функция дожидается, пока в дерево будут добавлены все элементы, добавленные в очередь до её вызова
+ */
+template<typename T, size_t arr_size>
+void IngestQueue<T, arr_size>::flush() {
+    const size_t target = pushed.load(std::memory_order_acquire);
+    wake.notify_one();
+    std::unique_lock<std::mutex> lock(flush_mutex);
+    flushed.wait(lock, [&] { return applied.load(std::memory_order_acquire) >= target; });
+}
+
+/**
+ * @brief Функция даёт доступ на чтение к дереву, пока поток-писатель не изменяет его
+ * @param func Функция, получающая ссылку на дерево
+ */
+template<typename T, size_t arr_size>
+void IngestQueue<T, arr_size>::read(const std::function<void(const Tree<T, arr_size> &)> &func) const {
+    std::lock_guard<std::mutex> lock(tree_mutex);
+    func(tree);
+}
@@ -0,0 +1,210 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+
+#include "StringArena.h"
+
+/**
+ * @brief Класс таблицы интернированных строк (режим дерева InternedString)
+ * каждая различная строка хранится один раз и получает номер, номера выдаются подряд с 0 (пустая строка).
+ * Таблица общая для всех деревьев процесса (global) и используется из нескольких потоков: поиск номера по строке
+ * идёт в одной из SHARD_COUNT частей хеш-таблицы под её разделяемой блокировкой, новая строка добавляется под
+ * исключительной блокировкой части и блокировкой области байтов. Строка по номеру читается без блокировок: строки
+ * лежат в блоках по CHUNK_SIZE представлений, блоки не перемещаются и публикуются атомарно.
+ *
+ * Номера имеют смысл только внутри процесса, поэтому в файлы (см. Serializer, Journal) пишутся сами строки
+ */
+class InternTable {
+    static constexpr size_t SHARD_COUNT = 64;
+    static constexpr uint32_t CHUNK_BITS = 16;
+    static constexpr uint32_t CHUNK_SIZE = 1u << CHUNK_BITS;
+    static constexpr size_t CHUNK_COUNT = size_t{1} << (32 - CHUNK_BITS);
+
+    struct Shard {
+        std::shared_mutex mutex;
+        std::unordered_map<std::string_view, uint32_t> ids;
+    };
+
+    Shard shards[SHARD_COUNT];
+    std::atomic<std::string_view *> chunks[CHUNK_COUNT] = {};
+
+    std::mutex strings_mutex;
+    StringArena strings;
+    uint32_t count = 0;
+
+    uint32_t add(std::string_view text);
+
+public:
+    InternTable() { intern(std::string_view()); }
+
+    ~InternTable() {
+        for (auto &chunk: chunks) {
+            delete[] chunk.load(std::memory_order_relaxed);
+        }
+    }
+
+    InternTable(const InternTable &) = delete;
+
+    InternTable &operator=(const InternTable &) = delete;
+
+    static InternTable &global() {
+        static InternTable table;
+        return table;
+    }
+
+    uint32_t intern(std::string_view text);
+
+    std::string_view lookup(const uint32_t id) const {
+        return chunks[id >> CHUNK_BITS].load(std::memory_order_acquire)[id & (CHUNK_SIZE - 1)];
+    }
+
+    size_t size() {
+        std::lock_guard lock(strings_mutex);
+        return count;
+    }
+
+    size_t bytes_allocated() {
+        std::lock_guard lock(strings_mutex);
+        return strings.bytes_allocated();
+    }
+};
+
+/**
+ * @brief Функция возвращает номер строки, добавляя её в таблицу при первом появлении
+ * @param text Строка
+ * @return Номер строки
+ */
+inline uint32_t InternTable::intern(const std::string_view text) {
+    Shard &shard = shards[std::hash<std::string_view>{}(text) % SHARD_COUNT];
+    {
+        std::shared_lock lock(shard.mutex);
+        if (const auto it = shard.ids.find(text); it != shard.ids.end()) {
+            return it->second;
+        }
+    }
+    std::unique_lock lock(shard.mutex);
+    if (const auto it = shard.ids.find(text); it != shard.ids.end()) {
+        return it->second;
+    }
+    const uint32_t id = add(text);
+    shard.ids.emplace(lookup(id), id);
+    return id;
+}
+
+/**
+ * @brief Функция копирует байты новой строки в область таблицы и выдаёт ей следующий номер
+ * @param text Строка
+ * @return Номер строки
+ */
+inline uint32_t InternTable::add(const std::string_view text) {
+    std::lock_guard lock(strings_mutex);
+    if (count == UINT32_MAX) {
+        throw std::runtime_error("Ошибка: в таблице строк закончились номера.");
+    }
+    const uint32_t id = count;
+    auto &chunk = chunks[id >> CHUNK_BITS];
+    std::string_view *views = chunk.load(std::memory_order_relaxed);
+    if (!views) {
+        views = new std::string_view[CHUNK_SIZE];
+        chunk.store(views, std::memory_order_release);
+    }
+    views[id & (CHUNK_SIZE - 1)] = strings.store(text);
+    ++count;
+    return id;
+}
+
+/**
+ * @brief Класс интернированной строки: элемент дерева - номер строки в InternTable::global() (4 байта)
+ * равенство сравнивает номера, порядок - байты строк (как у std::string), поэтому sort() и упорядоченная
+ * вставка дают тот же порядок, что и для std::string. Тип тривиально копируемый: вершины хранят номера в
+ * обычном массиве, в том числе с подкачкой (LeafPager)
+ */
+class InternedString {
+    uint32_t id = 0;
+
+public:
+    InternedString() = default;
+
+    InternedString(const std::string_view text) : id(InternTable::global().intern(text)) {
+    }
+
+    InternedString(const std::string &text) : InternedString(std::string_view(text)) {
+    }
+
+    InternedString(const char *text) : InternedString(std::string_view(text)) {
+    }
+
+    uint32_t get_id() const { return id; }
+
+    std::string_view view() const { return InternTable::global().lookup(id); }
+
+    const char *data() const { return view().data(); }
+
+    size_t size() const { return view().size(); }
+
+    explicit operator std::string() const { return std::string(view()); }
+
+    friend bool operator==(const InternedString left, const InternedString right) { return left.id == right.id; }
+
+    friend bool operator!=(const InternedString left, const InternedString right) { return left.id != right.id; }
+
+    friend bool operator<(const InternedString left, const InternedString right) {
+        return left.id != right.id && left.view() < right.view();
+    }
+
+    friend bool operator>(const InternedString left, const InternedString right) { return right < left; }
+
+    friend bool operator<=(const InternedString left, const InternedString right) { return !(right < left); }
+
+    friend bool operator>=(const InternedString left, const InternedString right) { return !(left < right); }
+
+    // сравнение со строкой другого типа (std::string_view, std::string, const char *) не добавляет её в таблицу,
+    // поэтому поиск по дереву (Tree::lower_bound, Tree::remove с ключом) не меняет InternTable
+    template<typename Key>
+    using if_text = std::enable_if_t<std::is_convertible_v<const Key &, std::string_view>, bool>;
+
+    template<typename Key>
+    friend if_text<Key> operator==(const InternedString left, const Key &right) {
+        return left.view() == std::string_view(right);
+    }
+
+    template<typename Key>
+    friend if_text<Key> operator==(const Key &left, const InternedString right) { return right == left; }
+
+    template<typename Key>
+    friend if_text<Key> operator!=(const InternedString left, const Key &right) { return !(left == right); }
+
+    template<typename Key>
+    friend if_text<Key> operator!=(const Key &left, const InternedString right) { return !(right == left); }
+
+    template<typename Key>
+    friend if_text<Key> operator<(const InternedString left, const Key &right) {
+        return left.view() < std::string_view(right);
+    }
+
+    template<typename Key>
+    friend if_text<Key> operator<(const Key &left, const InternedString right) {
+        return std::string_view(left) < right.view();
+    }
+
+    friend std::ostream &operator<<(std::ostream &os, const InternedString element) { return os << element.view(); }
+
+    friend std::istream &operator>>(std::istream &is, InternedString &element) {
+        std::string text;
+        if (is >> text) {
+            element = InternedString(text);
+        }
+        return is;
+    }
+};
@@ -0,0 +1,495 @@
+#pragma once
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include <type_traits>
+#include <unistd.h>
+#include <vector>
+
+#include "Tree.h"
+
+/**
+ * JOURNAL_OPERATION - тип записи журнала, значения хранятся в файле и не должны меняться
+ */
+enum class JOURNAL_OPERATION : uint8_t { INSERT = 1, INSERT_BY_INDEX = 2, REMOVE = 3, REMOVE_BY_INDEX = 4, SORT = 5 };
+
+constexpr char JOURNAL_MAGIC[4] = {'K', 'J', 'R', 'N'};
+
+/**
+ * @brief Заголовок файла журнала
+ * generation - номер снимка, к которому применяются записи журнала
+ */
+struct JournalHeader {
+    char magic[4];
+    uint32_t reserved;
+    uint64_t generation;
+};
+
+/**
+ * @brief Класс журнала изменений дерева с восстановлением после сбоя
+ * @tparam T Тип хранимых данных
+ * @tparam arr_size Размер массива в конечной вершине
+ *
+ * Изменения применяются к дереву и дописываются в конец журнала path.journal. Записи копятся в буфере и
+ * сбрасываются на диск одной записью и одним fsync на группу из group_size изменений (групповая фиксация) или
+ * при вызове commit(), поэтому надёжность стоит одной синхронизации на группу, а не на изменение.
+ *
+ * Запись журнала: uint32_t длина тела, uint32_t контрольная сумма тела, тело - тип операции, uint64_t номер и
+ * значение. Строковые значения (std::string, std::string_view, InternedString) пишутся длиной и байтами строки,
+ * остальные - байтами значения; указатели (в том числе char*) не поддерживаются, потому что после перезапуска
+ * они ни на что не указывают. Недописанная при сбое последняя
+ * запись не проходит проверку и отбрасывается при восстановлении.
+ *
+ * checkpoint() записывает полный снимок path.snapshot.<поколение> и атомарно (через rename) заменяет журнал
+ * пустым журналом следующего поколения, после чего старый снимок удаляется. Поколение в заголовке журнала
+ * указывает, к какому снимку относятся записи, поэтому сбой на любом шаге не приводит к повторному применению
+ * записей. Конструктор восстанавливает дерево: загружает снимок поколения журнала и применяет записи журнала.
+ */
+template<typename T, size_t arr_size>
+class Journal {
+    // значения, которые пишутся в журнал как строки, а не байтами объекта
+    static constexpr bool is_text = std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view> ||
+                                    std::is_same_v<T, InternedString>;
+
+    static_assert(is_text || (std::is_trivially_copyable_v<T> && !std::is_pointer_v<T>),
+                  "Journal stores strings or trivially copyable values without pointers");
+
+    Tree<T, arr_size> &tree;
+
+    const std::string path;
+
+    const size_t group_size;
+
+    int descriptor = -1;
+
+    uint64_t generation = 0;
+
+    std::vector<char> buffer;
+
+    size_t pending = 0;
+
+    std::string journal_path() const { return path + ".journal"; }
+
+    std::string snapshot_path(const uint64_t snapshot_generation) const {
+        return path + ".snapshot." + std::to_string(snapshot_generation);
+    }
+
+    void append(JOURNAL_OPERATION operation, uint64_t index, const T *value);
+
+    void recover();
+
+    void replay(const char *body, size_t size);
+
+    void open_for_append(uint64_t offset);
+
+    void write_all(int file, const char *bytes, size_t size) const;
+
+    static void sync(int file);
+
+    static void sync_directory(const std::string &file_path);
+
+    static uint32_t checksum(const char *bytes, size_t size);
+
+public:
+    explicit Journal(Tree<T, arr_size> &tree, std::string path, size_t group_size = 64);
+
+    ~Journal();
+
+    Journal(const Journal &) = delete;
+
+    Journal &operator=(const Journal &) = delete;
+
+    bool insert(const T &element);
+
+    bool insert_by_index(size_t index, const T &element);
+
+    bool remove(const T &element);
+
+    bool remove_by_index(size_t index);
+
+    bool sort();
+
+    void commit();
+
+    void checkpoint();
+
+    size_t pending_count() const { return pending; }
+};
+
+/**
+ * @brief Конструктор восстанавливает дерево из снимка и журнала и открывает журнал для дозаписи
+ * @param tree Дерево, содержимое которого заменяется восстановленным
+ * @param path Путь без расширения, от которого строятся имена журнала и снимков
+ * @param group_size Количество изменений в одной группе фиксации
+ */
+template<typename T, size_t arr_size>
+Journal<T, arr_size>::Journal(Tree<T, arr_size> &tree, std::string path, const size_t group_size)
+    : tree(tree), path(std::move(path)), group_size(group_size == 0 ? 1 : group_size) {
+    recover();
+}
+
+/**
+ * @brief Деструктор фиксирует накопленные изменения
+ */
+template<typename T, size_t arr_size>
+Journal<T, arr_size>::~Journal() {
+    try {
+        commit();
+    } catch (const std::exception &) {
+    }
+    if (descriptor >= 0) {
+        ::close(descriptor);
+    }
+}
+
+template<typename T, size_t arr_size>
+bool Journal<T, arr_size>::insert(const T &element) {
+    if (!tree.insert(element)) {
+        return false;
+    }
+    append(JOURNAL_OPERATION::INSERT, 0, &element);
+    return true;
+}
+
+template<typename T, size_t arr_size>
+bool Journal<T, arr_size>::insert_by_index(const size_t index, const T &element) {
+    if (!tree.insert_by_index(index, element)) {
+        return false;
+    }
+    append(JOURNAL_OPERATION::INSERT_BY_INDEX, index, &element);
+    return true;
+}
+
+template<typename T, size_t arr_size>
+bool Journal<T, arr_size>::remove(const T &element) {
+    if (!tree.remove(element)) {
+        return false;
+    }
+    append(JOURNAL_OPERATION::REMOVE, 0, &element);
+    return true;
+}
+
+template<typename T, size_t arr_size>
+bool Journal<T, arr_size>::remove_by_index(const size_t index) {
+    if (!tree.remove_by_index(index)) {
+        return false;
+    }
+    append(JOURNAL_OPERATION::REMOVE_BY_INDEX, index, nullptr);
+    return true;
+}
+
+template<typename T, size_t arr_size>
+bool Journal<T, arr_size>::sort() {
+    if (!tree.sort()) {
+        return false;
+    }
+    append(JOURNAL_OPERATION::SORT, 0, nullptr);
+    return true;
+}
+
+/**
+ * @brief Функция дописывает запись в буфер и фиксирует группу, когда она заполнена
+ * @param operation Тип операции
+ * @param index Номер элемента для операций по номеру
+ * @param value Значение элемента или nullptr для операций без значения
+ */
+template<typename T, size_t arr_size>
+void Journal<T, arr_size>::append(const JOURNAL_OPERATION operation, const uint64_t index, const T *value) {
+    std::vector<char> body(1 + sizeof(uint64_t));
+    body[0] = static_cast<char>(operation);
+    std::memcpy(body.data() + 1, &index, sizeof(index));
+    if (value) {
+        if constexpr (is_text) {
+            // указатель и номер InternedString действительны только в процессе, поэтому пишется сама строка
+            const std::string_view text(value->data(), value->size());
+            const auto length = static_cast<uint32_t>(text.size());
+            body.insert(body.end(), reinterpret_cast<const char *>(&length),
+                        reinterpret_cast<const char *>(&length) + sizeof(length));
+            body.insert(body.end(), text.begin(), text.end());
+        } else {
+            body.insert(body.end(), reinterpret_cast<const char *>(value),
+                        reinterpret_cast<const char *>(value) + sizeof(T));
+        }
+    }
+
+    const auto size = static_cast<uint32_t>(body.size());
+    const uint32_t sum = checksum(body.data(), body.size());
+    buffer.insert(buffer.end(), reinterpret_cast<const char *>(&size),
+                  reinterpret_cast<const char *>(&size) + sizeof(size));
+    buffer.insert(buffer.end(), reinterpret_cast<const char *>(&sum),
+                  reinterpret_cast<const char *>(&sum) + sizeof(sum));
+    buffer.insert(buffer.end(), body.begin(), body.end());
+
+    if (++pending >= group_size) {
+        commit();
+    }
+}
+
+/**
+ * @brief Функция записывает накопленные изменения в журнал и дожидается их сохранения на диске
+ */
+template<typename T, size_t arr_size>
+void Journal<T, arr_size>::commit() {
+    if (buffer.empty()) {
+        return;
+    }
+    write_all(descriptor, buffer.data(), buffer.size());
+    sync(descriptor);
+    buffer.clear();
+    pending = 0;
+}
+
+/**
+ * @brief Функция сохраняет полный снимок дерева и начинает пустой журнал следующего поколения
+ * точка фиксации - rename нового журнала поверх старого: до неё восстановление использует старый снимок и
+ * старый журнал, после - новый снимок и пустой журнал
+ */
+template<typename T, size_t arr_size>
+void Journal<T, arr_size>::checkpoint() {
+    commit();
+
+    const uint64_t next = generation + 1;
+    {
+        std::ofstream ofs(snapshot_path(next), std::ios::binary | std::ios::trunc);
+        if (!ofs) {
+            throw std::runtime_error("Ошибка: не удалось создать снимок: " + snapshot_path(next));
+        }
+        tree.save_to_binary_file(ofs);
+    }
+    const int snapshot = ::open(snapshot_path(next).c_str(), O_RDONLY);
+    if (snapshot < 0) {
+        throw std::runtime_error("Ошибка: не удалось открыть снимок: " + snapshot_path(next));
+    }
+    sync(snapshot);
+    ::close(snapshot);
+
+    const std::string temporary = journal_path() + ".tmp";
+    const int file = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (file < 0) {
+        throw std::runtime_error("Ошибка: не удалось создать журнал: " + temporary);
+    }
+    JournalHeader header{};
+    std::memcpy(header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+    header.generation = next;
+    try {
+        write_all(file, reinterpret_cast<const char *>(&header), sizeof(header));
+        sync(file);
+    } catch (...) {
+        ::close(file);
+        throw;
+    }
+    ::close(file);
+
+    if (::rename(temporary.c_str(), journal_path().c_str()) != 0) {
+        throw std::runtime_error("Ошибка: не удалось заменить журнал: " + journal_path());
+    }
+    sync_directory(journal_path());
+
+    std::remove(snapshot_path(generation).c_str());
+    generation = next;
+    open_for_append(sizeof(JournalHeader));
+}
+
+/**
+ * @brief Функция восстанавливает дерево: загружает снимок поколения журнала и применяет все целые записи
+ * недописанный хвост журнала отрезается, чтобы новые записи шли сразу за последней целой
+ */
+template<typename T, size_t arr_size>
+void Journal<T, arr_size>::recover() {
+    std::ifstream ifs(journal_path(), std::ios::binary);
+    if (!ifs) {
+        const int file = ::open(journal_path().c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (file < 0) {
+            throw std::runtime_error("Ошибка: не удалось создать журнал: " + journal_path());
+        }
+        JournalHeader header{};
+        std::memcpy(header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+        try {
+            write_all(file, reinterpret_cast<const char *>(&header), sizeof(header));
+            sync(file);
+        } catch (...) {
+            ::close(file);
+            throw;
+        }
+        ::close(file);
+        sync_directory(journal_path());
+        tree.clear();
+        generation = 0;
+        open_for_append(sizeof(JournalHeader));
+        return;
+    }
+
+    std::vector<char> contents((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    JournalHeader header{};
+    if (contents.size() < sizeof(header)) {
+        throw std::runtime_error("Ошибка: повреждён заголовок журнала: " + journal_path());
+    }
+    std::memcpy(&header, contents.data(), sizeof(header));
+    if (std::memcmp(header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0) {
+        throw std::runtime_error("Ошибка: файл не является журналом: " + journal_path());
+    }
+    generation = header.generation;
+
+    tree.clear();
+    if (generation > 0) {
+        std::ifstream snapshot(snapshot_path(generation), std::ios::binary);
+        if (!snapshot) {
+            throw std::runtime_error("Ошибка: не найден снимок журнала: " + snapshot_path(generation));
+        }
+        tree.load_from_binary_file(snapshot);
+    }
+
+    size_t offset = sizeof(header);
+    while (contents.size() - offset >= 2 * sizeof(uint32_t)) {
+        uint32_t size, sum;
+        std::memcpy(&size, contents.data() + offset, sizeof(size));
+        std::memcpy(&sum, contents.data() + offset + sizeof(size), sizeof(sum));
+        const size_t body = offset + 2 * sizeof(uint32_t);
+        if (size > contents.size() - body || checksum(contents.data() + body, size) != sum) {
+            break;
+        }
+        replay(contents.data() + body, size);
+        offset = body + size;
+    }
+    open_for_append(offset);
+}
+
+/**
+ * @brief Функция применяет к дереву одну запись журнала
+ * @param body Тело записи
+ * @param size Размер тела записи
+ */
+template<typename T, size_t arr_size>
+void Journal<T, arr_size>::replay(const char *body, const size_t size) {
+    if (size < 1 + sizeof(uint64_t)) {
+        throw std::runtime_error("Ошибка: повреждена запись журнала.");
+    }
+    const auto operation = static_cast<JOURNAL_OPERATION>(body[0]);
+    uint64_t index;
+    std::memcpy(&index, body + 1, sizeof(index));
+    const char *payload = body + 1 + sizeof(uint64_t);
+    const size_t payload_size = size - 1 - sizeof(uint64_t);
+
+    // для std::string_view элемент ссылается на тело записи, дерево копирует байты при вставке
+    auto value = [&] {
+        T element{};
+        if constexpr (is_text) {
+            uint32_t length;
+            if (payload_size < sizeof(length)) {
+                throw std::runtime_error("Ошибка: повреждена запись журнала.");
+            }
+            std::memcpy(&length, payload, sizeof(length));
+            if (payload_size != sizeof(length) + length) {
+                throw std::runtime_error("Ошибка: повреждена запись журнала.");
+            }
+            element = T(std::string_view(payload + sizeof(length), length));
+        } else {
+            if (payload_size != sizeof(T)) {
+                throw std::runtime_error("Ошибка: повреждена запись журнала.");
+            }
+            std::memcpy(&element, payload, sizeof(T));
+        }
+        return element;
+    };
+
+    switch (operation) {
+        case JOURNAL_OPERATION::INSERT: tree.insert(value());
+            break;
+        case JOURNAL_OPERATION::INSERT_BY_INDEX: tree.insert_by_index(index, value());
+            break;
+        case JOURNAL_OPERATION::REMOVE: tree.remove(value());
+            break;
+        case JOURNAL_OPERATION::REMOVE_BY_INDEX: tree.remove_by_index(index);
+            break;
+        case JOURNAL_OPERATION::SORT: tree.sort();
+            break;
+        default: throw std::runtime_error("Ошибка: неизвестная операция в журнале.");
+    }
+}
+
+/**
+ * @brief Функция открывает журнал для дозаписи, отрезая всё после offset
+ * @param offset Размер целой части журнала
+ */
+template<typename T, size_t arr_size>
+void Journal<T, arr_size>::open_for_append(const uint64_t offset) {
+    if (descriptor >= 0) {
+        ::close(descriptor);
+    }
+    descriptor = ::open(journal_path().c_str(), O_WRONLY);
+    if (descriptor < 0) {
+        throw std::runtime_error("Ошибка: не удалось открыть журнал: " + journal_path());
+    }
+    if (::ftruncate(descriptor, static_cast<off_t>(offset)) != 0 ||
+        ::lseek(descriptor, static_cast<off_t>(offset), SEEK_SET) < 0) {
+        throw std::runtime_error("Ошибка: не удалось подготовить журнал к записи: " + journal_path());
+    }
+    buffer.clear();
+    pending = 0;
+}
+
+template<typename T, size_t arr_size>
+void Journal<T, arr_size>::write_all(const int file, const char *bytes, size_t size) const {
+    while (size > 0) {
+        const ssize_t written = ::write(file, bytes, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("Ошибка: не удалось записать журнал: " + journal_path());
+        }
+        bytes += written;
+        size -= static_cast<size_t>(written);
+    }
+}
+
+/**
+ * @brief Функция дожидается сохранения данных файла на диске
+ * на macOS fsync не сбрасывает кэш накопителя, для этого нужен F_FULLFSYNC
+ */
+template<typename T, size_t arr_size>
+void Journal<T, arr_size>::sync(const int file) {
+#ifdef F_FULLFSYNC
+    if (::fcntl(file, F_FULLFSYNC) == 0) {
+        return;
+    }
+#endif
+    if (::fsync(file) != 0) {
+        throw std::runtime_error("Ошибка: не удалось сохранить журнал на диск.");
+    }
+}
+
+/**
+ * @brief Функция сохраняет на диске запись каталога, чтобы созданный или переименованный файл пережил сбой
+ * @param file_path Путь к файлу в каталоге
+ */
+template<typename T, size_t arr_size>
+void Journal<T, arr_size>::sync_directory(const std::string &file_path) {
+    const size_t slash = file_path.find_last_of('/');
+    const std::string directory = slash == std::string::npos ? "." : file_path.substr(0, slash + 1);
+    const int file = ::open(directory.c_str(), O_RDONLY);
+    if (file >= 0) {
+        ::fsync(file);
+        ::close(file);
+    }
+}
+
+/**
+ * @brief Функция считает контрольную сумму FNV-1a
+ */
+template<typename T, size_t arr_size>
+uint32_t Journal<T, arr_size>::checksum(const char *bytes, const size_t size) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<unsigned char>(bytes[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
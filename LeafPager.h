@@ -0,0 +1,204 @@
+#pragma once
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <fcntl.h>
+#include <list>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+template<typename T, size_t arr_size>
+class LeafNode;
+
+/**
+ * @brief Класс подкачки конечных вершин на диск (режим работы дерева больше оперативной памяти)
+ * @tparam T Тип элементов, должен быть тривиально копируемым
+ * @tparam arr_size Размер массива в конечной вершине
+ *
+ * Каждой конечной вершине дерева с подкачкой выделяется ячейка файла размером arr_size * sizeof(T) байт. В памяти
+ * одновременно лежат массивы не больше resident_leaves вершин: при обращении к вершине (см. LeafNode::load) она
+ * становится самой свежей в списке LRU, а если массивов в памяти стало больше, вытесняется давно не
+ * использовавшаяся вершина - её массив записывается в ячейку, если изменялся после чтения, и освобождается.
+ * Размер вершины и промежуточные вершины со счётчиками остаются в памяти, поэтому спуск по номеру читает с диска
+ * только одну конечную вершину.
+ *
+ * Файл удаляется из каталога сразу после открытия и служит только продолжением памяти, для сохранения дерева
+ * используются обычные форматы (см. CheckpointFile). Ячейки удалённых вершин используются повторно.
+ *
+ * Массив вершины действителен, пока не вызвано обращение к другим resident_leaves вершинам, поэтому
+ * resident_leaves не меньше MIN_RESIDENT_LEAVES (операции дерева одновременно держат несколько вершин), а
+ * дерево с подкачкой используется из одного потока
+ */
+template<typename T, size_t arr_size>
+class LeafPager {
+    static constexpr size_t MIN_RESIDENT_LEAVES = 8;
+    static constexpr uint64_t SLOT_BYTES = arr_size * sizeof(T);
+
+    using Leaf = LeafNode<T, arr_size>;
+
+    struct Page {
+        typename std::list<const Leaf *>::iterator position;
+        uint64_t slot = 0;
+        bool is_resident = true;
+        bool is_dirty = true;
+    };
+
+    int descriptor = -1;
+    size_t capacity;
+    std::list<const Leaf *> recent;
+    std::unordered_map<const Leaf *, Page> pages;
+    std::vector<uint64_t> free_slots;
+    uint64_t slot_count = 0;
+    uint64_t reads = 0;
+    uint64_t writes = 0;
+
+    void evict();
+
+public:
+    LeafPager(const std::string &path, size_t resident_leaves);
+
+    ~LeafPager() {
+        if (descriptor >= 0) {
+            ::close(descriptor);
+        }
+    }
+
+    LeafPager(const LeafPager &) = delete;
+
+    LeafPager &operator=(const LeafPager &) = delete;
+
+    void access(const Leaf *leaf, bool write);
+
+    void forget(const Leaf *leaf) noexcept;
+
+    size_t resident_count() const { return recent.size(); }
+
+    size_t leaf_count() const { return pages.size(); }
+
+    uint64_t get_reads() const { return reads; }
+
+    uint64_t get_writes() const { return writes; }
+};
+
+/**
+ * @brief Конструктор создаёт файл подкачки
+ * @param path Путь к файлу, существующий файл перезаписывается
+ * @param resident_leaves Количество конечных вершин, массивы которых одновременно лежат в памяти
+ */
+template<typename T, size_t arr_size>
+LeafPager<T, arr_size>::LeafPager(const std::string &path, const size_t resident_leaves)
+    : capacity(std::max(resident_leaves, MIN_RESIDENT_LEAVES)) {
+    static_assert(std::is_trivially_copyable_v<T> && !std::is_pointer_v<T>,
+                  "leaf paging requires a trivially copyable element type");
+    descriptor = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (descriptor < 0) {
+        throw std::runtime_error("Ошибка: файл подкачки не удалось открыть: " + path);
+    }
+    ::unlink(path.c_str());
+}
+
+/**
+ * @brief Функция вызывается при каждом обращении к конечной вершине: новая вершина получает ячейку, вытесненная
+ * читается из своей ячейки, после чего вершина становится самой свежей и лишние вершины вытесняются
+ * @param leaf Вершина
+ * @param write true - если вершина будет изменена
+ */
+template<typename T, size_t arr_size>
+void LeafPager<T, arr_size>::access(const Leaf *leaf, const bool write) {
+    auto [it, is_new] = pages.try_emplace(leaf);
+    Page &page = it->second;
+
+    if (is_new) {
+        if (free_slots.empty()) {
+            page.slot = slot_count++;
+        } else {
+            page.slot = free_slots.back();
+            free_slots.pop_back();
+        }
+        recent.push_front(leaf);
+        page.position = recent.begin();
+    } else if (page.is_resident) {
+        recent.splice(recent.begin(), recent, page.position);
+    } else {
+        auto data = std::make_unique<T[]>(arr_size + 1);
+        auto *bytes = reinterpret_cast<char *>(data.get());
+        const size_t size = leaf->actual_size * sizeof(T);
+        for (size_t done = 0; done < size;) {
+            const ssize_t count = ::pread(descriptor, bytes + done, size - done,
+                                          static_cast<off_t>(page.slot * SLOT_BYTES + done));
+            if (count <= 0) {
+                if (count < 0 && errno == EINTR) {
+                    continue;
+                }
+                throw std::runtime_error("Ошибка: не удалось прочитать вершину из файла подкачки.");
+            }
+            done += static_cast<size_t>(count);
+        }
+        data[leaf->actual_size] = T{};
+        leaf->data = std::move(data);
+        ++reads;
+
+        recent.push_front(leaf);
+        page.position = recent.begin();
+        page.is_resident = true;
+        page.is_dirty = false;
+    }
+
+    page.is_dirty = page.is_dirty || write;
+    while (recent.size() > capacity) {
+        evict();
+    }
+}
+
+/**
+ * @brief Функция вытесняет давно не использовавшуюся вершину
+ */
+template<typename T, size_t arr_size>
+void LeafPager<T, arr_size>::evict() {
+    const Leaf *leaf = recent.back();
+    Page &page = pages.at(leaf);
+
+    if (page.is_dirty) {
+        const auto *bytes = reinterpret_cast<const char *>(leaf->data.get());
+        const size_t size = leaf->actual_size * sizeof(T);
+        for (size_t done = 0; done < size;) {
+            const ssize_t count = ::pwrite(descriptor, bytes + done, size - done,
+                                           static_cast<off_t>(page.slot * SLOT_BYTES + done));
+            if (count < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::runtime_error("Ошибка: не удалось записать вершину в файл подкачки.");
+            }
+            done += static_cast<size_t>(count);
+        }
+        ++writes;
+    }
+
+    leaf->data.reset();
+    recent.pop_back();
+    page.is_resident = false;
+    page.is_dirty = false;
+}
+
+/**
+ * @brief Функция вызывается при удалении вершины и освобождает её ячейку
+ * @param leaf Вершина
+ */
+template<typename T, size_t arr_size>
+void LeafPager<T, arr_size>::forget(const Leaf *leaf) noexcept {
+    const auto it = pages.find(leaf);
+    if (it == pages.end()) {
+        return;
+    }
+    if (it->second.is_resident) {
+        recent.erase(it->second.position);
+    }
+    free_slots.push_back(it->second.slot);
+    pages.erase(it);
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief Класс отображения файла в память только для чтения
+ * страницы файла подгружаются операционной системой при первом обращении, поэтому открытие не зависит от размера
+ * файла. Дескриптор закрывается сразу после отображения, отображение освобождается в деструкторе
+ */
+class MappedFile {
+    const char *bytes = nullptr;
+    size_t length = 0;
+
+public:
+    explicit MappedFile(const std::string &path) {
+        const int descriptor = ::open(path.c_str(), O_RDONLY);
+        if (descriptor < 0) {
+            throw std::runtime_error("Ошибка: файл не удалось открыть для чтения: " + path);
+        }
+        struct stat info{};
+        if (::fstat(descriptor, &info) != 0) {
+            ::close(descriptor);
+            throw std::runtime_error("Ошибка: не удалось получить размер файла: " + path);
+        }
+        length = static_cast<size_t>(info.st_size);
+        if (length > 0) {
+            void *address = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+            if (address == MAP_FAILED) {
+                ::close(descriptor);
+                throw std::runtime_error("Ошибка: файл не удалось отобразить в память: " + path);
+            }
+            bytes = static_cast<const char *>(address);
+        }
+        ::close(descriptor);
+    }
+
+    ~MappedFile() {
+        if (bytes) {
+            ::munmap(const_cast<char *>(bytes), length);
+        }
+    }
+
+    MappedFile(const MappedFile &) = delete;
+
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    MappedFile(MappedFile &&other) noexcept : bytes(other.bytes), length(other.length) {
+        other.bytes = nullptr;
+        other.length = 0;
+    }
+
+    MappedFile &operator=(MappedFile &&other) noexcept {
+        if (this != &other) {
+            if (bytes) {
+                ::munmap(const_cast<char *>(bytes), length);
+            }
+            bytes = other.bytes;
+            length = other.length;
+            other.bytes = nullptr;
+            other.length = 0;
+        }
+        return *this;
+    }
+
+    const char *data() const { return bytes; }
+
+    size_t size() const { return length; }
+
+    /**
+     * @brief Функция сообщает системе, что файл будет читаться последовательно, чтобы она читала страницы заранее
+     */
+    void advise_sequential() const {
+        if (bytes) {
+            ::madvise(const_cast<char *>(bytes), length, MADV_SEQUENTIAL);
+        }
+    }
+};
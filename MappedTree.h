@@ -0,0 +1,183 @@
+#pragma once
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "BinaryFormat.h"
+#include "MappedFile.h"
+#include "Tree.h"
+
+/**
+ * @brief Класс дерева только для чтения поверх снимка, отображённого в память
+ * @tparam T Тип хранимых данных
+ * @tparam arr_size Размер массива в конечной вершине
+ *
+ * Открытие читает только заголовок и BinaryFooter, поэтому не зависит от объёма данных. Индекс конечных вершин
+ * хранит смещения их записей и количество элементов перед ними, по нему элемент с логическим номером находится
+ * двоичным поиском. Элементы читаются прямо из отображения, LeafNode создаётся только по запросу get_leaf()
+ * (копия элементов одной вершины) и не запоминается, поэтому объект не изменяется после открытия и его можно
+ * читать из нескольких потоков без блокировок
+ */
+template<typename T, size_t arr_size>
+class MappedTree {
+    static_assert(std::is_trivially_copyable_v<T>, "MappedTree reads elements in place");
+
+    MappedFile file;
+    BinaryHeader header{};
+    const uint64_t *index = nullptr;
+
+    size_t find_leaf(size_t index) const;
+
+public:
+    explicit MappedTree(const std::string &path);
+
+    size_t size() const { return header.element_count; }
+
+    size_t leaf_count() const { return header.leaf_count; }
+
+    size_t leaf_size(size_t leaf) const;
+
+    const T *leaf_data(size_t leaf) const;
+
+    std::shared_ptr<LeafNode<T, arr_size>> get_leaf(size_t leaf) const;
+
+    T get_by_index(size_t index) const;
+
+    T operator[](const size_t index) const { return get_by_index(index); }
+
+    void for_each(const std::function<void(const T &)> &func) const;
+
+    Tree<T, arr_size> to_tree() const;
+};
+
+/**
+ * @brief Конструктор открывает снимок и проверяет заголовок и индекс конечных вершин
+ * @param path Путь к файлу, записанному Tree::save_to_binary_file
+ */
+template<typename T, size_t arr_size>
+MappedTree<T, arr_size>::MappedTree(const std::string &path): file(path) {
+    if (file.size() < sizeof(BinaryHeader) + sizeof(BinaryFooter)) {
+        throw std::runtime_error("Ошибка: файл слишком мал для снимка дерева.");
+    }
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (normalize_header(header)) {
+        throw std::runtime_error("Ошибка: снимок записан с другим порядком байт.");
+    }
+    if (header.version != BINARY_VERSION || !(header.flags & BINARY_FLAG_LEAF_INDEX)) {
+        throw std::runtime_error("Ошибка: снимок не содержит индекса конечных вершин.");
+    }
+    if (header.flags & BINARY_FLAG_DELTA_VARINT) {
+        throw std::runtime_error("Ошибка: сжатый снимок нельзя читать на месте, используйте Tree::load_from_binary_file.");
+    }
+    if (header.element_size != sizeof(T)) {
+        throw std::runtime_error("Ошибка: размер элемента в файле не совпадает с типом дерева.");
+    }
+
+    BinaryFooter footer{};
+    std::memcpy(&footer, file.data() + file.size() - sizeof(footer), sizeof(footer));
+    if (std::memcmp(footer.magic, BINARY_FOOTER_MAGIC, sizeof(BINARY_FOOTER_MAGIC)) != 0 ||
+        footer.index_offset % BINARY_ALIGNMENT != 0 ||
+        footer.index_offset + 2 * header.leaf_count * sizeof(uint64_t) + sizeof(footer) > file.size()) {
+        throw std::runtime_error("Ошибка: повреждён индекс снимка.");
+    }
+    index = reinterpret_cast<const uint64_t *>(file.data() + footer.index_offset);
+}
+
+/**
+ * @brief Функция находит конечную вершину, содержащую элемент с логическим номером
+ * @param index Логический номер
+ * @return Номер конечной вершины в индексе
+ */
+template<typename T, size_t arr_size>
+size_t MappedTree<T, arr_size>::find_leaf(const size_t index) const {
+    if (index >= header.element_count) {
+        throw std::out_of_range("Index out of bounds");
+    }
+    size_t low = 0;
+    size_t high = header.leaf_count;
+    while (high - low > 1) {
+        const size_t mid = low + (high - low) / 2;
+        if (this->index[2 * mid + 1] <= index) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+template<typename T, size_t arr_size>
+size_t MappedTree<T, arr_size>::leaf_size(const size_t leaf) const {
+    uint64_t size;
+    std::memcpy(&size, file.data() + index[2 * leaf], sizeof(size));
+    return size;
+}
+
+/**
+ * @brief Функция возвращает указатель на элементы конечной вершины внутри отображения
+ * @param leaf Номер конечной вершины
+ */
+template<typename T, size_t arr_size>
+const T *MappedTree<T, arr_size>::leaf_data(const size_t leaf) const {
+    return reinterpret_cast<const T *>(file.data() + index[2 * leaf] + sizeof(uint64_t));
+}
+
+/**
+ * @brief Функция создаёт конечную вершину с копией элементов вершины снимка
+ * @param leaf Номер конечной вершины
+ * @return Указатель на новую вершину, не связанную со снимком
+ */
+template<typename T, size_t arr_size>
+std::shared_ptr<LeafNode<T, arr_size>> MappedTree<T, arr_size>::get_leaf(const size_t leaf) const {
+    if (leaf >= header.leaf_count) {
+        throw std::out_of_range("Leaf index out of bounds");
+    }
+    auto node = std::make_shared<LeafNode<T, arr_size>>();
+    if (!node->assign(leaf_data(leaf), leaf_size(leaf))) {
+        throw std::runtime_error("Ошибка: конечная вершина снимка больше arr_size.");
+    }
+    return node;
+}
+
+template<typename T, size_t arr_size>
+T MappedTree<T, arr_size>::get_by_index(const size_t index) const {
+    const size_t leaf = find_leaf(index);
+    return leaf_data(leaf)[index - this->index[2 * leaf + 1]];
+}
+
+template<typename T, size_t arr_size>
+void MappedTree<T, arr_size>::for_each(const std::function<void(const T &)> &func) const {
+    for (size_t leaf = 0; leaf < header.leaf_count; ++leaf) {
+        const T *data = leaf_data(leaf);
+        for (size_t i = 0, size = leaf_size(leaf); i < size; ++i) {
+            func(data[i]);
+        }
+    }
+}
+
+/**
+ * @brief Функция переносит снимок в обычное изменяемое дерево
+ * @return Дерево с теми же конечными вершинами, не разделяющее их со снимком
+ */
+template<typename T, size_t arr_size>
+Tree<T, arr_size> MappedTree<T, arr_size>::to_tree() const {
+    Tree<T, arr_size> tree;
+    if (header.arr_size != arr_size) {
+        std::vector<T> elements;
+        elements.reserve(header.element_count);
+        for_each([&](const T &element) { elements.push_back(element); });
+        tree.append(elements);
+        return tree;
+    }
+
+    std::vector<std::shared_ptr<TreeNode<T>>> nodes;
+    nodes.reserve(header.leaf_count);
+    for (size_t leaf = 0; leaf < header.leaf_count; ++leaf) {
+        nodes.push_back(get_leaf(leaf));
+    }
+    tree.build_from_leaves(nodes);
+    return tree;
+}
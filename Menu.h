@@ -2,6 +2,7 @@
 #include "Tree.h"
 #include <iostream>
 #include <fstream>
+#include <future>
 
 template<typename T, size_t arr_size>
 class Menu {
@@ -11,6 +12,10 @@ public:
 private:
     Tree<T, arr_size> tree;
 
+    std::future<void> pending_save;
+
+    void wait_for_save();
+
     void print_menu();
 
     void add_element();
@@ -87,6 +92,7 @@ void Menu<T, arr_size>::run() {
                 std::cout << "\033[H";
         }
     } while (choice != 0);
+    wait_for_save();
 }
 
 template<typename T, size_t arr_size>
@@ -196,27 +202,40 @@ void Menu<T, arr_size>::save_to_text_file() {
 
 template<typename T, size_t arr_size>
 void Menu<T, arr_size>::load_from_text_file() {
-    std::ifstream file("tree.txt");
-    if (file) {
-        file >> tree;
+    try {
+        tree.load_from_text_file("tree.txt");
         std::cout << "Tree loaded from text file.\n";
-    } else {
-        std::cout << "Failed to open file.\n";
+    } catch (const std::exception &e) {
+        std::cout << "Failed to load tree: " << e.what() << "\n";
     }
 }
 
+/**
+ * @brief Функция дожидается окончания фонового сохранения и сообщает его результат
+ */
 template<typename T, size_t arr_size>
-void Menu<T, arr_size>::save_to_binary_file() {
-    if (std::ofstream file("tree.bin", std::ios::binary); file) {
-        tree.save_to_binary_file(file);
+void Menu<T, arr_size>::wait_for_save() {
+    if (!pending_save.valid()) {
+        return;
+    }
+    try {
+        pending_save.get();
         std::cout << "Tree saved to binary file.\n";
-    } else {
-        std::cout << "Failed to open file.\n";
+    } catch (const std::exception &e) {
+        std::cout << "Failed to save tree: " << e.what() << "\n";
     }
 }
 
+template<typename T, size_t arr_size>
+void Menu<T, arr_size>::save_to_binary_file() {
+    wait_for_save();
+    pending_save = tree.save_async("tree.bin", is_delta_encodable_v<T> ? ENCODING::DELTA_VARINT : ENCODING::RAW);
+    std::cout << "Saving tree to binary file in background.\n";
+}
+
 template<typename T, size_t arr_size>
 void Menu<T, arr_size>::load_from_binary_file() {
+    wait_for_save();
     if (std::ifstream file("tree.bin", std::ios::binary); file) {
         tree.load_from_binary_file(file);
         std::cout << "Tree loaded from binary file.\n";
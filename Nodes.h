@@ -1,5 +1,15 @@
 #pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
 #include <sstream>
+#include <type_traits>
+#include <vector>
+
+#include "LeafPager.h"
+#include "Serializer.h"
+#include "TextIO.h"
 
 /**
  * Classes
@@ -8,7 +18,7 @@
  *
  * TreeNode<T> - абстрактный класс вершины
  *
- * LeafNode - класс конечной вершины
+ * LeafNode - класс конечной вершины, для std::string - специализация с упакованными байтами строк
  *
  * IntermediateNode - класс промежуточной вершины
  */
@@ -17,18 +27,49 @@ enum class TYPE { LEAF, INTERMEDIATE };
 
 /**
  * Класс TreeNode<T> является интерфейсом, он позволяет использовать полиморфизм для лучшего управления поддеревьями
+ *
+ * dirty - вершина (для промежуточной - хотя бы одна вершина поддерева) изменена после последней записи в файл
+ * контрольной точки stored_file, где её запись лежит по смещению stored_offset и вместе с поддеревом занимает
+ * stored_bytes байт (см. CheckpointFile)
  */
 template<typename T>
 class TreeNode {
+    bool dirty = true;
+    uint64_t stored_file = 0;
+    uint64_t stored_offset = 0;
+    uint64_t stored_bytes = 0;
+
 public:
     virtual ~TreeNode() = default;
 
+    void mark_dirty() { dirty = true; }
+
+    bool is_dirty() const { return dirty; }
+
+    bool is_stored_in(const uint64_t file) const { return !dirty && stored_file == file; }
+
+    void mark_stored(const uint64_t file, const uint64_t offset, const uint64_t bytes) {
+        dirty = false;
+        stored_file = file;
+        stored_offset = offset;
+        stored_bytes = bytes;
+    }
+
+    uint64_t get_stored_offset() const { return stored_offset; }
+
+    uint64_t get_stored_bytes() const { return stored_bytes; }
+
     virtual TYPE get_type() = 0;
 
     virtual std::string to_string() = 0;
 
     virtual size_t get_size() = 0;
 
+    virtual size_t get_newline_count() = 0;
+
+    // высота поддерева: 0 у конечной вершины (см. IntermediateNode::height)
+    virtual size_t get_height() { return 0; }
+
     virtual explicit operator std::string() = 0;
 
     virtual T get_max_value() = 0;
@@ -40,11 +81,43 @@ public:
  * @tparam arr_size используется для задания размера массива на этапе компиляции
  *
  * при инициализации создаётся умный указатель на массив с данными и последний элемент становиться NULL
+ * (для типов, не являющихся указателями, ограничителем служит значение по умолчанию T{}, см. terminator())
+ *
+ * для T = char* вершина хранит собственные копии строк и освобождает их при удалении элементов
+ *
+ * вершина дерева с подкачкой (pager != nullptr) может не держать массив в памяти, каждый метод, обращающийся к
+ * элементам, сначала вызывает load (см. LeafPager)
  */
 template<typename T, size_t arr_size>
 class LeafNode final : public TreeNode<T> {
-    std::unique_ptr<T[]> data;
+    friend class LeafPager<T, arr_size>;
+
+    mutable std::unique_ptr<T[]> data;
     size_t actual_size = 0;
+    // для T = char количество символов '\n' в вершине, обновляется при каждом изменении элементов, поэтому
+    // IntermediateNode::update_size не перечитывает вершину и не загружает её из файла подкачки
+    size_t newlines = 0;
+    std::shared_ptr<LeafPager<T, arr_size>> pager;
+
+    static size_t newline_weight(const T &element) {
+        if constexpr (std::is_same_v<T, char>) {
+            return element == '\n' ? 1 : 0;
+        } else {
+            return 0;
+        }
+    }
+
+    void load(const bool write) const {
+        if (pager) {
+            pager->access(this, write);
+        }
+    }
+
+    static T terminator();
+
+    static T own(T element);
+
+    static void release(T &element);
 
 public:
     void get_all_elements(std::vector<T> &elements);
@@ -53,25 +126,84 @@ public:
 
     LeafNode() {
         data = std::make_unique<T[]>(arr_size + 1);
-        data[actual_size] = NULL;
+        data[actual_size] = terminator();
+    }
+
+    explicit LeafNode(std::shared_ptr<LeafPager<T, arr_size>> pager) : LeafNode() {
+        this->pager = std::move(pager);
+        load(true);
+    }
+
+    ~LeafNode() override {
+        if (pager) {
+            pager->forget(this);
+            return;
+        }
+        for (size_t i = 0; i < actual_size; ++i) {
+            release(data[i]);
+        }
     }
 
     size_t get_size() override { return actual_size; }
 
+    size_t get_newline_count() override { return newlines; }
+
     std::string to_string() override;
 
     bool add_element(T element);
 
-    bool remove_element(T element);
+    template<typename Matches>
+    bool remove_matching(Matches &&matches);
 
     bool remove_by_index(int index);
 
     explicit operator std::string() override { return to_string(); }
 
+    const T *raw_data() const {
+        load(false);
+        return data.get();
+    }
+
+    const T &element_view(const size_t index) const {
+        load(false);
+        return data[index];
+    }
+
+    const void *element_address(const size_t index) const {
+        load(false);
+        return data.get() + index;
+    }
+
+    /**
+     * @brief Функция двоичным поиском находит первый элемент упорядоченной по less вершины, не меньший key
+     * @return Номер элемента или get_size(), если все элементы меньше
+     */
+    template<typename Key, typename Less>
+    size_t lower_bound(const Key &key, const Less &less) const {
+        load(false);
+        return std::lower_bound(data.get(), data.get() + actual_size, key, less) - data.get();
+    }
+
+    template<typename Func>
+    void for_each_element(Func &&func) const {
+        load(false);
+        for (size_t i = 0; i < actual_size; ++i) {
+            func(data[i]);
+        }
+    }
+
+    bool copy_from(const LeafNode &other) { return assign(other.raw_data(), other.actual_size); }
+
+    void write_block(BinaryWriter &writer) const {
+        load(false);
+        Serializer<T>::write_block(writer, data.get(), actual_size);
+    }
+
     T get_element_at(size_t index) const {
         if (index >= actual_size) {
             throw std::out_of_range("index out of range");
         }
+        load(false);
         return data[index];
     }
 
@@ -83,6 +215,9 @@ public:
 
     bool insert_by_index(size_t index, T element);
 
+    template<typename It>
+    bool assign(It elements, size_t count);
+
     bool remove_by_index(size_t index);
 
     bool clear_elements();
@@ -93,7 +228,10 @@ public:
         return elements;
     }
 
-    T get_max_value() override { return data[actual_size - 1]; }
+    T get_max_value() override {
+        load(false);
+        return data[actual_size - 1];
+    }
 };
 
 /**
@@ -104,12 +242,28 @@ public:
  * @param left_node указатель на левое поддерево, используется умный указатель, а так же тип TreeNode<T>
  * @param right_node указатель на правое поддерево, используется умный указатель, а так же тип TreeNode<T>
  *
+ * @param left_count закэшированное количество элементов в левом поддереве
+ * @param count закэшированное количество элементов в поддереве, обновляется при смене поддеревьев и вызовом
+ * update_size() после изменения поддеревьев. update_size() вызывается на всём пути от изменённой вершины до
+ * корня, поэтому он же помечает вершину изменённой
+ *
+ * @param left_newlines, newlines для T = char закэшированное количество символов '\n' в левом поддереве и во всём
+ * поддереве, обновляются вместе с count (см. текстовые функции Tree); для остальных типов равны нулю
+ *
+ * @param height закэшированная высота поддерева, обновляется вместе с count; по ней Tree::join сохраняет
+ * баланс при сборке изменённых поддеревьев
+ *
  * при инициализации указатели на поддеревья по-умолчанию имеют тип nullptr
  */
 template<typename T, size_t arr_size>
 class IntermediateNode final : public TreeNode<T> {
     std::shared_ptr<TreeNode<T>> left_node;
     std::shared_ptr<TreeNode<T>> right_node;
+    size_t left_count = 0;
+    size_t count = 0;
+    size_t left_newlines = 0;
+    size_t newlines = 0;
+    size_t height = 1;
 
 public:
     void get_all_elements(std::vector<T> &elements);
@@ -121,10 +275,38 @@ public:
 
     std::string to_string() override;
 
-    size_t get_size() override {
-        const size_t left_size = left_node ? left_node->get_size() : 0;
-        const size_t right_size = right_node ? right_node->get_size() : 0;
-        return left_size + right_size;
+    size_t get_size() override { return count; }
+
+    size_t get_left_size() const { return left_count; }
+
+    size_t get_newline_count() override { return newlines; }
+
+    size_t get_left_newline_count() const { return left_newlines; }
+
+    size_t get_height() override { return height; }
+
+    /**
+     * @brief Функция пересчитывает размеры по поддеревьям, вершина помечается изменённой, только если изменились
+     * её счётчики или изменено одно из поддеревьев
+     */
+    void update_size() {
+        const size_t old_left_count = left_count;
+        const size_t old_count = count;
+        const size_t old_height = height;
+        left_count = left_node ? left_node->get_size() : 0;
+        count = left_count + (right_node ? right_node->get_size() : 0);
+        height = 1 + std::max(left_node ? left_node->get_height() : 0, right_node ? right_node->get_height() : 0);
+        bool is_changed = left_count != old_left_count || count != old_count || height != old_height ||
+                          (left_node && left_node->is_dirty()) || (right_node && right_node->is_dirty());
+        if constexpr (std::is_same_v<T, char>) {
+            const size_t old_newlines = newlines;
+            left_newlines = left_node ? left_node->get_newline_count() : 0;
+            newlines = left_newlines + (right_node ? right_node->get_newline_count() : 0);
+            is_changed = is_changed || newlines != old_newlines;
+        }
+        if (is_changed) {
+            this->mark_dirty();
+        }
     }
 
     explicit operator std::string() override { return to_string(); }
@@ -216,6 +398,8 @@ std::shared_ptr<TreeNode<T>> &IntermediateNode<T, arr_size>::get_right_node() {
 template<typename T, size_t arr_size>
 bool IntermediateNode<T, arr_size>::set_left_node(const std::shared_ptr<TreeNode<T>> &new_left_node) {
     left_node = std::dynamic_pointer_cast<TreeNode<T>>(new_left_node);
+    this->mark_dirty();
+    update_size();
     return left_node != nullptr && left_node->get_type() == TYPE::INTERMEDIATE;
 }
 
@@ -228,26 +412,67 @@ bool IntermediateNode<T, arr_size>::set_left_node(const std::shared_ptr<TreeNode
 template<typename T, size_t arr_size>
 bool IntermediateNode<T, arr_size>::set_right_node(const std::shared_ptr<TreeNode<T>> &new_right_node) {
     right_node = std::dynamic_pointer_cast<TreeNode<T>>(new_right_node);
+    this->mark_dirty();
+    update_size();
     return right_node != nullptr && right_node->get_type() == TYPE::INTERMEDIATE;
 }
 
+/**
+ * @brief Функция возвращает значение-ограничитель массива: NULL для указателей и значение по умолчанию для
+ * остальных типов (например, std::string нельзя создать из NULL)
+ */
+template<typename T, size_t arr_size>
+T LeafNode<T, arr_size>::terminator() {
+    if constexpr (std::is_pointer_v<T>) {
+        return nullptr;
+    } else {
+        return T{};
+    }
+}
+
+/**
+ * @brief Функция возвращает значение, которое хранится в вершине: для char* - собственную копию строки
+ * @param element Добавляемый элемент
+ */
+template<typename T, size_t arr_size>
+T LeafNode<T, arr_size>::own(T element) {
+    if constexpr (std::is_same_v<T, char *>) {
+        char *copy = new char[std::strlen(element) + 1];
+        std::strcpy(copy, element);
+        return copy;
+    } else {
+        return element;
+    }
+}
+
+/**
+ * @brief Функция освобождает элемент, удаляемый из вершины: для char* - собственную копию строки
+ * @param element Удаляемый элемент
+ */
+template<typename T, size_t arr_size>
+void LeafNode<T, arr_size>::release(T &element) {
+    if constexpr (std::is_same_v<T, char *>) {
+        delete[] element;
+        element = nullptr;
+    }
+}
+
 /**
  * @brief Функция превращает промежуточный узел в подстроку
  * @return Строку состоящую из преобразованного конечного узла
  */
 template<typename T, size_t arr_size>
 std::string LeafNode<T, arr_size>::to_string() {
-    std::ostringstream os;
-    os << "LeafNode(actual_size = " << actual_size << ")" << ": [";
-    for (int i = 0; data[i] != NULL; i++) {
-        if (data[i + 1] == NULL) {
-            os << data[i];
-        } else {
-            os << data[i] << ", ";
+    load(false);
+    std::string text = "LeafNode(actual_size = " + std::to_string(actual_size) + "): [";
+    for (size_t i = 0; i < actual_size; i++) {
+        append_text_element(text, data[i]);
+        if (i + 1 != actual_size) {
+            text += ", ";
         }
     }
-    os << "]" << std::endl;
-    return os.str();
+    text += "]\n";
+    return text;
 }
 
 
@@ -260,40 +485,48 @@ std::string LeafNode<T, arr_size>::to_string() {
 template<typename T, size_t arr_size>
 bool LeafNode<T, arr_size>::add_element(T element) {
     if (actual_size < arr_size) {
-        if constexpr (std::is_same_v<T, char *>) {
-            size_t len = std::strlen(element);
-            std::cout << len << std::endl;
-            data[actual_size] = new char[len + 1];
-            std::strcpy(data[actual_size], element);
-            actual_size++;
-            return true;
-        } else {
-            data[actual_size++] = element;
-            data[actual_size] = NULL;
-            return true;
-        }
+        load(true);
+        this->mark_dirty();
+        newlines += newline_weight(element);
+        data[actual_size++] = own(std::move(element));
+        data[actual_size] = terminator();
+        return true;
     }
     return false;
 }
 
 /**
- * @brief Функция удаляет элемент
- * @param element Элемент который необходимо удалить
+ * @brief Функция удаляет все элементы, для которых matches возвращает true
+ * @param matches Условие удаления
  * @return true - Если удаление произошло успешно
  * @return false - Если возникли проблемы при удалении 
  */
 template<typename T, size_t arr_size>
-bool LeafNode<T, arr_size>::remove_element(T element) {
-    std::unique_ptr<T[]> temp = std::make_unique<T[]>(arr_size);
-    for (int i = 0, j = 0; data[i] != NULL; i++) {
-        if (data[i] != element) {
-            temp[j] = data[i];
+template<typename Matches>
+bool LeafNode<T, arr_size>::remove_matching(Matches &&matches) {
+    load(false);
+    size_t j = 0;
+    while (j < actual_size && !matches(static_cast<const T &>(data[j]))) {
+        j++;
+    }
+    if (j == actual_size) {
+        return true;
+    }
+    load(true);
+    this->mark_dirty();
+    for (size_t i = j; i < actual_size; i++) {
+        if (!matches(static_cast<const T &>(data[i]))) {
+            if (i != j) {
+                data[j] = std::move(data[i]);
+            }
             j++;
         } else {
-            actual_size--;
+            newlines -= newline_weight(data[i]);
+            release(data[i]);
         }
     }
-    data = std::move(temp);
+    actual_size = j;
+    data[actual_size] = terminator();
     return true;
 }
 
@@ -304,56 +537,95 @@ bool LeafNode<T, arr_size>::remove_element(T element) {
  */
 template<typename T, size_t arr_size>
 bool LeafNode<T, arr_size>::remove_by_index(const int index) {
-    if (index < 0 || index >= actual_size) {
+    if (index < 0 || static_cast<size_t>(index) >= actual_size) {
         throw std::out_of_range("Leaf node index out of range");
     }
-    std::unique_ptr<T[]> temp = std::make_unique<T[]>(arr_size);
-    for (int i = 0, j = 0; data[i] != NULL; i++) {
-        if (i != index) {
-            temp[j] = data[i];
-            j++;
-        } else {
-            actual_size--;
-        }
-    }
-    data = std::move(temp);
-    return true;
+    return remove_by_index(static_cast<size_t>(index));
 }
 
 template<typename T, size_t arr_size>
 bool LeafNode<T, arr_size>::insert_by_index(size_t index, T element) {
-    if (index > arr_size || actual_size >= arr_size) {
+    if (index > actual_size || actual_size >= arr_size) {
         return false;
     }
+    load(true);
+    this->mark_dirty();
 
     for (size_t i = actual_size; i > index; --i) {
-        data[i] = data[i - 1];
+        data[i] = std::move(data[i - 1]);
     }
 
-    data[index] = element;
+    newlines += newline_weight(element);
+    data[index] = own(std::move(element));
 
     ++actual_size;
+    data[actual_size] = terminator();
     return true;
 }
 
 template<typename T, size_t arr_size>
 bool LeafNode<T, arr_size>::remove_by_index(const size_t index) {
-    if (index > arr_size || actual_size >= arr_size) {
-        throw std::out_of_range("Index out of bounds or leaf is full");
+    if (index >= actual_size) {
+        throw std::out_of_range("Index out of bounds");
     }
+    load(true);
+    this->mark_dirty();
 
+    newlines -= newline_weight(data[index]);
+    release(data[index]);
     for (size_t i = index; i < actual_size - 1; ++i) {
-        data[i] = data[i + 1];
+        data[i] = std::move(data[i + 1]);
     }
     --actual_size;
+    data[actual_size] = terminator();
+    return true;
+}
+
+/**
+ * @brief Функция заменяет содержимое вершины блоком элементов, для тривиально копируемых типов - одной
+ * операцией копирования
+ * @param elements Итератор на первый элемент блока (для переноса строк можно передать std::move_iterator)
+ * @param count Количество элементов
+ * @return true - Если элементы поместились в вершину
+ * @return false - Если элементов больше, чем arr_size
+ */
+template<typename T, size_t arr_size>
+template<typename It>
+bool LeafNode<T, arr_size>::assign(It elements, const size_t count) {
+    if (count > arr_size) {
+        return false;
+    }
+    load(true);
+    this->mark_dirty();
+    for (size_t i = 0; i < actual_size; ++i) {
+        release(data[i]);
+    }
+    if constexpr (std::is_trivially_copyable_v<T> && !std::is_same_v<T, char *>) {
+        std::copy_n(elements, count, data.get());
+    } else {
+        for (size_t i = 0; i < count; ++i, ++elements) {
+            data[i] = own(*elements);
+        }
+    }
+    actual_size = count;
+    data[actual_size] = terminator();
+    if constexpr (std::is_same_v<T, char>) {
+        newlines = std::count(data.get(), data.get() + actual_size, '\n');
+    }
     return true;
 }
 
 template<typename T, size_t arr_size>
 bool LeafNode<T, arr_size>::clear_elements() {
+    load(true);
+    this->mark_dirty();
+    for (size_t i = 0; i < actual_size; ++i) {
+        release(data[i]);
+    }
     data = std::make_unique<T[]>(arr_size + 1);
     actual_size = 0;
-    data[actual_size] = NULL;
+    newlines = 0;
+    data[actual_size] = terminator();
     return true;
 }
 
@@ -363,7 +635,545 @@ bool LeafNode<T, arr_size>::clear_elements() {
  */
 template<typename T, size_t arr_size>
 void LeafNode<T, arr_size>::get_all_elements(std::vector<T> &elements) {
-    for (int i = 0; data[i] != NULL; i++) {
+    load(false);
+    for (size_t i = 0; i < actual_size; i++) {
         elements.push_back(data[i]);
     }
 }
+
+/**
+ * @brief Специализация конечной вершины для std::string
+ * @tparam arr_size используется для задания размера массива на этапе компиляции
+ *
+ * байты всех строк вершины лежат подряд в одном массиве bytes, строка i занимает [offsets[i], offsets[i + 1]).
+ * Элементы не требуют отдельных выделений памяти, доступ к ним идёт через std::string_view (element_view,
+ * for_each_element), а блок вершины в бинарном формате (см. StringBlockSerializer) пишется одной записью байт.
+ * Удаление сдвигает байты следующих строк, поэтому в массиве нет пустых участков.
+ *
+ * интерфейс совпадает с общей вершиной, кроме raw_data(); методы, возвращающие T, создают std::string. Подкачка
+ * (LeafPager) для строк не поддерживается, указатель на неё в конструкторе всегда пустой
+ *
+ * вершина упорядоченного дерева может быть сжата общими префиксами (front_code, см. Tree::compress_prefixes):
+ * запись i в [offsets[i], offsets[i + 1]) - длина общего с предыдущей строкой префикса (varint) и остаток
+ * строки, а каждая FRONT_CODING_RESTART-я запись хранит строку целиком без длины. Строка восстанавливается от
+ * ближайшей полной записи, полные записи служат опорными точками двоичного поиска (lower_bound). Методы чтения
+ * раскодируют строки сами, изменяющие методы сначала возвращают вершину к обычному виду (expand)
+ */
+template<size_t arr_size>
+class LeafNode<std::string, arr_size> final : public TreeNode<std::string> {
+    static constexpr size_t FRONT_CODING_RESTART = 16;
+
+    uint32_t offsets[arr_size + 1] = {};
+    std::vector<char> bytes;
+    size_t actual_size = 0;
+    bool is_front_coded = false;
+
+    void insert_bytes(size_t index, std::string_view element);
+
+    std::string_view entry(const size_t index) const {
+        return {bytes.data() + offsets[index], offsets[index + 1] - offsets[index]};
+    }
+
+    static size_t read_prefix(std::string_view &suffix);
+
+    std::string_view decode(size_t index, std::string &buffer) const;
+
+    void expand();
+
+public:
+    void get_all_elements(std::vector<std::string> &elements);
+
+    TYPE get_type() override { return TYPE::LEAF; }
+
+    LeafNode() = default;
+
+    explicit LeafNode(const std::shared_ptr<LeafPager<std::string, arr_size>> &) {
+    }
+
+    size_t get_size() override { return actual_size; }
+
+    size_t get_newline_count() override { return 0; }
+
+    std::string to_string() override;
+
+    bool add_element(const std::string &element);
+
+    template<typename Matches>
+    bool remove_matching(Matches &&matches);
+
+    bool remove_by_index(int index);
+
+    explicit operator std::string() override { return to_string(); }
+
+    /**
+     * @brief Функция возвращает строку index; строка сжатой вершины раскодируется в буфер потока и действительна
+     * до следующего вызова element_view в этом потоке
+     */
+    std::string_view element_view(const size_t index) const {
+        if (!is_front_coded) {
+            return entry(index);
+        }
+        thread_local std::string buffer;
+        return decode(index, buffer);
+    }
+
+    const void *element_address(const size_t index) const { return bytes.data() + offsets[index]; }
+
+    template<typename Func>
+    void for_each_element(Func &&func) const {
+        if (!is_front_coded) {
+            for (size_t i = 0; i < actual_size; ++i) {
+                func(entry(i));
+            }
+            return;
+        }
+        std::string current;
+        for (size_t i = 0; i < actual_size; ++i) {
+            std::string_view suffix = entry(i);
+            current.resize(i % FRONT_CODING_RESTART == 0 ? 0 : read_prefix(suffix));
+            current.append(suffix.data(), suffix.size());
+            func(std::string_view(current));
+        }
+    }
+
+    std::string get_element_at(size_t index) const {
+        if (index >= actual_size) {
+            throw std::out_of_range("index out of range");
+        }
+        std::string element;
+        if (const std::string_view view = decode(index, element); view.data() != element.data()) {
+            element.assign(view.data(), view.size());
+        }
+        return element;
+    }
+
+    template<typename Key, typename Less>
+    size_t lower_bound(const Key &key, const Less &less) const;
+
+    size_t front_code();
+
+    bool is_compressed() const { return is_front_coded; }
+
+    size_t byte_count() const { return bytes.size(); }
+
+    void add_elements(const std::vector<std::string> &elements) {
+        for (const auto &element: elements) {
+            add_element(element);
+        }
+    }
+
+    bool insert_by_index(size_t index, const std::string &element);
+
+    template<typename It>
+    bool assign(It elements, size_t count);
+
+    bool remove_by_index(size_t index);
+
+    bool clear_elements();
+
+    bool copy_from(const LeafNode &other);
+
+    void write_block(BinaryWriter &writer) const;
+
+    bool read_block(BinaryReader &reader, size_t count, bool is_swapped);
+
+    std::vector<std::string> get_data() {
+        std::vector<std::string> elements;
+        get_all_elements(elements);
+        return elements;
+    }
+
+    std::string get_max_value() override { return get_element_at(actual_size - 1); }
+};
+
+/**
+ * @brief Функция читает длину общего префикса из начала записи сжатой вершины
+ * @param suffix Запись, после вызова - остаток строки
+ * @return Длина префикса
+ */
+template<size_t arr_size>
+size_t LeafNode<std::string, arr_size>::read_prefix(std::string_view &suffix) {
+    size_t prefix = 0;
+    for (int shift = 0;; shift += 7) {
+        const auto byte = static_cast<unsigned char>(suffix.front());
+        suffix.remove_prefix(1);
+        prefix |= static_cast<size_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return prefix;
+        }
+    }
+}
+
+/**
+ * @brief Функция восстанавливает строку index сжатой вершины от ближайшей полной записи
+ * @param index Номер строки
+ * @param buffer Буфер для восстановленной строки
+ * @return Строка: полная запись - без копирования, остальные - в buffer
+ */
+template<size_t arr_size>
+std::string_view LeafNode<std::string, arr_size>::decode(const size_t index, std::string &buffer) const {
+    const size_t restart = index - index % FRONT_CODING_RESTART;
+    if (!is_front_coded || restart == index) {
+        return entry(index);
+    }
+    const std::string_view first = entry(restart);
+    buffer.assign(first.data(), first.size());
+    for (size_t i = restart + 1; i <= index; ++i) {
+        std::string_view suffix = entry(i);
+        buffer.resize(read_prefix(suffix));
+        buffer.append(suffix.data(), suffix.size());
+    }
+    return buffer;
+}
+
+/**
+ * @brief Функция сжимает строки вершины общими префиксами соседних строк, вершина остаётся обычной, если сжатие
+ * не уменьшает её
+ * @return Количество освобождённых байт
+ */
+template<size_t arr_size>
+size_t LeafNode<std::string, arr_size>::front_code() {
+    if (is_front_coded || actual_size == 0) {
+        return 0;
+    }
+    this->mark_dirty();
+    std::vector<char> coded;
+    coded.reserve(bytes.size());
+    uint32_t coded_offsets[arr_size + 1];
+    coded_offsets[0] = 0;
+    for (size_t i = 0; i < actual_size; ++i) {
+        const std::string_view element = entry(i);
+        size_t prefix = 0;
+        if (i % FRONT_CODING_RESTART != 0) {
+            const std::string_view previous = entry(i - 1);
+            const size_t limit = std::min(previous.size(), element.size());
+            while (prefix < limit && previous[prefix] == element[prefix]) {
+                ++prefix;
+            }
+            for (size_t value = prefix; ; value >>= 7) {
+                coded.push_back(static_cast<char>(value >= 0x80 ? (value & 0x7F) | 0x80 : value));
+                if (value < 0x80) {
+                    break;
+                }
+            }
+        }
+        coded.insert(coded.end(), element.begin() + prefix, element.end());
+        coded_offsets[i + 1] = static_cast<uint32_t>(coded.size());
+    }
+
+    if (coded.size() >= bytes.size()) {
+        // у соседних строк почти нет общих префиксов
+        return 0;
+    }
+    const size_t freed = bytes.capacity() - coded.size();
+    coded.shrink_to_fit();
+    bytes = std::move(coded);
+    std::copy_n(coded_offsets, actual_size + 1, offsets);
+    is_front_coded = true;
+    return freed;
+}
+
+/**
+ * @brief Функция возвращает сжатую вершину к обычному виду перед изменением
+ */
+template<size_t arr_size>
+void LeafNode<std::string, arr_size>::expand() {
+    if (!is_front_coded) {
+        return;
+    }
+    std::vector<char> plain;
+    uint32_t plain_offsets[arr_size + 1];
+    plain_offsets[0] = 0;
+    size_t i = 0;
+    for_each_element([&](const std::string_view element) {
+        plain.insert(plain.end(), element.begin(), element.end());
+        plain_offsets[++i] = static_cast<uint32_t>(plain.size());
+    });
+    bytes = std::move(plain);
+    std::copy_n(plain_offsets, actual_size + 1, offsets);
+    is_front_coded = false;
+}
+
+/**
+ * @brief Функция двоичным поиском находит первую строку упорядоченной по less вершины, не меньшую key; у сжатой
+ * вершины поиск идёт по полным записям, затем строки одного участка раскодируются по порядку
+ * @param key Строка или ключ, сравнимый с std::string_view
+ * @param less Порядок строк вершины
+ * @return Номер строки или get_size(), если все строки меньше
+ */
+template<size_t arr_size>
+template<typename Key, typename Less>
+size_t LeafNode<std::string, arr_size>::lower_bound(const Key &key, const Less &less) const {
+    const size_t step = is_front_coded ? FRONT_CODING_RESTART : 1;
+    // количество опорных строк (номера 0, step, 2 * step, ...), меньших key
+    size_t low = 0;
+    size_t high = (actual_size + step - 1) / step;
+    while (low < high) {
+        const size_t middle = (low + high) / 2;
+        if (less(entry(middle * step), key)) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    if (low == 0 || step == 1) {
+        return low * step;
+    }
+
+    size_t index = (low - 1) * step;
+    std::string current(entry(index));
+    for (++index; index < actual_size && index < low * step; ++index) {
+        std::string_view suffix = entry(index);
+        current.resize(read_prefix(suffix));
+        current.append(suffix.data(), suffix.size());
+        if (!less(std::string_view(current), key)) {
+            return index;
+        }
+    }
+    return index;
+}
+
+/**
+ * @brief Функция вставляет байты строки перед строкой index и сдвигает смещения следующих строк
+ * @param index Номер строки
+ * @param element Строка
+ */
+template<size_t arr_size>
+void LeafNode<std::string, arr_size>::insert_bytes(const size_t index, const std::string_view element) {
+    if (bytes.size() + element.size() > UINT32_MAX) {
+        throw std::runtime_error("Ошибка: строки не помещаются в конечную вершину.");
+    }
+    const auto length = static_cast<uint32_t>(element.size());
+    bytes.insert(bytes.begin() + offsets[index], element.begin(), element.end());
+    for (size_t i = actual_size + 1; i > index; --i) {
+        offsets[i] = offsets[i - 1] + length;
+    }
+    ++actual_size;
+}
+
+/**
+ * @brief Функция превращает конечный узел в подстроку
+ * @return Строку состоящую из преобразованного конечного узла
+ */
+template<size_t arr_size>
+std::string LeafNode<std::string, arr_size>::to_string() {
+    std::string text = "LeafNode(actual_size = " + std::to_string(actual_size) + "): [";
+    size_t i = 0;
+    for_each_element([&](const std::string_view element) {
+        append_text_element(text, element);
+        if (++i != actual_size) {
+            text += ", ";
+        }
+    });
+    text += "]\n";
+    return text;
+}
+
+template<size_t arr_size>
+bool LeafNode<std::string, arr_size>::add_element(const std::string &element) {
+    if (actual_size < arr_size) {
+        this->mark_dirty();
+        expand();
+        insert_bytes(actual_size, element);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Функция удаляет все строки, для которых matches возвращает true, оставшиеся строки сдвигаются к началу
+ * за один проход
+ * @param matches Условие удаления, получает std::string_view
+ * @return true - Если удаление произошло успешно
+ */
+template<size_t arr_size>
+template<typename Matches>
+bool LeafNode<std::string, arr_size>::remove_matching(Matches &&matches) {
+    bool is_found = false;
+    for_each_element([&](const std::string_view current) { is_found = is_found || matches(current); });
+    if (!is_found) {
+        return true;
+    }
+    this->mark_dirty();
+    if (is_front_coded) {
+        expand();
+    }
+    size_t j = 0;
+    uint32_t begin = 0;
+    uint32_t written = 0;
+    for (size_t i = 0; i < actual_size; i++) {
+        const uint32_t end = offsets[i + 1];
+        if (!matches(std::string_view(bytes.data() + begin, end - begin))) {
+            std::memmove(bytes.data() + written, bytes.data() + begin, end - begin);
+            written += end - begin;
+            offsets[++j] = written;
+        }
+        begin = end;
+    }
+    actual_size = j;
+    bytes.resize(written);
+    return true;
+}
+
+template<size_t arr_size>
+bool LeafNode<std::string, arr_size>::remove_by_index(const int index) {
+    if (index < 0 || static_cast<size_t>(index) >= actual_size) {
+        throw std::out_of_range("Leaf node index out of range");
+    }
+    return remove_by_index(static_cast<size_t>(index));
+}
+
+template<size_t arr_size>
+bool LeafNode<std::string, arr_size>::insert_by_index(const size_t index, const std::string &element) {
+    if (index > actual_size || actual_size >= arr_size) {
+        return false;
+    }
+    this->mark_dirty();
+    expand();
+    insert_bytes(index, element);
+    return true;
+}
+
+template<size_t arr_size>
+bool LeafNode<std::string, arr_size>::remove_by_index(const size_t index) {
+    if (index >= actual_size) {
+        throw std::out_of_range("Index out of bounds");
+    }
+    this->mark_dirty();
+    expand();
+
+    const uint32_t length = offsets[index + 1] - offsets[index];
+    bytes.erase(bytes.begin() + offsets[index], bytes.begin() + offsets[index + 1]);
+    for (size_t i = index + 1; i < actual_size; ++i) {
+        offsets[i] = offsets[i + 1] - length;
+    }
+    --actual_size;
+    return true;
+}
+
+/**
+ * @brief Функция заменяет содержимое вершины блоком строк
+ * @param elements Итератор на первый элемент блока (элементы приводятся к std::string_view)
+ * @param count Количество элементов
+ * @return true - Если элементы поместились в вершину
+ * @return false - Если элементов больше, чем arr_size
+ */
+template<size_t arr_size>
+template<typename It>
+bool LeafNode<std::string, arr_size>::assign(It elements, const size_t count) {
+    if (count > arr_size) {
+        return false;
+    }
+    this->mark_dirty();
+    bytes.clear();
+    actual_size = 0;
+    is_front_coded = false;
+    for (size_t i = 0; i < count; ++i, ++elements) {
+        const std::string_view element = *elements;
+        insert_bytes(actual_size, element);
+    }
+    return true;
+}
+
+template<size_t arr_size>
+bool LeafNode<std::string, arr_size>::clear_elements() {
+    this->mark_dirty();
+    std::vector<char>().swap(bytes);
+    actual_size = 0;
+    is_front_coded = false;
+    return true;
+}
+
+/**
+ * @brief Функция копирует содержимое другой вершины без разбора на отдельные строки
+ * @param other Вершина-источник
+ */
+template<size_t arr_size>
+bool LeafNode<std::string, arr_size>::copy_from(const LeafNode &other) {
+    this->mark_dirty();
+    std::copy_n(other.offsets, other.actual_size + 1, offsets);
+    bytes = other.bytes;
+    actual_size = other.actual_size;
+    is_front_coded = other.is_front_coded;
+    return true;
+}
+
+/**
+ * @brief Функция пишет блок вершины в формате StringBlockSerializer: длины строк и затем все байты одной записью
+ * @param writer Поток записи
+ */
+template<size_t arr_size>
+void LeafNode<std::string, arr_size>::write_block(BinaryWriter &writer) const {
+    if (is_front_coded) {
+        // формат файла не зависит от сжатия вершины
+        LeafNode plain;
+        plain.copy_from(*this);
+        plain.expand();
+        plain.write_block(writer);
+        return;
+    }
+    std::vector<uint32_t> lengths(actual_size);
+    for (size_t i = 0; i < actual_size; ++i) {
+        lengths[i] = offsets[i + 1] - offsets[i];
+    }
+    writer.write_value(static_cast<uint64_t>(actual_size * sizeof(uint32_t) + bytes.size()));
+    writer.write(lengths.data(), lengths.size() * sizeof(uint32_t));
+    writer.write(bytes.data(), bytes.size());
+}
+
+/**
+ * @brief Функция заменяет содержимое вершины блоком строк бинарного файла (формат StringBlockSerializer)
+ * длины строк читаются прямо в массив смещений и складываются в смещения, байты всех строк читаются одной
+ * записью в массив байт вершины, поэтому на вершину приходится одно выделение памяти
+ * @param reader Поток чтения
+ * @param count Количество строк
+ * @param is_swapped Файл записан с другим порядком байт
+ * @return false - Если строк больше, чем arr_size
+ */
+template<size_t arr_size>
+bool LeafNode<std::string, arr_size>::read_block(BinaryReader &reader, const size_t count, const bool is_swapped) {
+    if (count > arr_size) {
+        return false;
+    }
+    this->mark_dirty();
+    actual_size = 0;
+    is_front_coded = false;
+
+    auto block_size = reader.read_value<uint64_t>();
+    reader.read(offsets + 1, count * sizeof(uint32_t));
+    if (is_swapped) {
+        swap_bytes(&block_size, sizeof(block_size));
+    }
+    uint64_t size = 0;
+    offsets[0] = 0;
+    for (size_t i = 1; i <= count; ++i) {
+        if (is_swapped) {
+            swap_bytes(&offsets[i], sizeof(offsets[i]));
+        }
+        size += offsets[i];
+        if (size > UINT32_MAX) {
+            throw std::runtime_error("Ошибка: строки не помещаются в конечную вершину.");
+        }
+        offsets[i] = static_cast<uint32_t>(size);
+    }
+    if (block_size != size + count * sizeof(uint32_t)) {
+        throw std::runtime_error("Ошибка: повреждён блок строк в бинарном файле.");
+    }
+
+    bytes.clear();
+    bytes.resize(size);
+    reader.read(bytes.data(), bytes.size());
+    actual_size = count;
+    return true;
+}
+
+/**
+ * @brief Получает все элементы в конечном узле
+ * @param elements Указатель на вектор элементор
+ */
+template<size_t arr_size>
+void LeafNode<std::string, arr_size>::get_all_elements(std::vector<std::string> &elements) {
+    for_each_element([&elements](const std::string_view element) {
+        elements.emplace_back(element);
+    });
+}
@@ -0,0 +1,177 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "BinaryFormat.h"
+#include "InternTable.h"
+#include "StringArena.h"
+
+/**
+ * @brief Шаблон сериализации блока элементов одной конечной вершины в бинарный формат
+ * @tparam T Тип хранимых данных
+ *
+ * element_size - размер элемента в заголовке файла, 0 для элементов переменной длины
+ *
+ * write_block - записывает count элементов одним блоком
+ *
+ * read_block - читает count элементов; is_swapped - файл записан с другим порядком байт; arena - область памяти
+ * дерева для типов, которые ссылаются на байты, но не владеют ими (std::string_view)
+ *
+ * Для типов без специализации сохранение в бинарный файл не компилируется
+ */
+template<typename T, typename Enable = void>
+struct Serializer;
+
+/**
+ * @brief Сериализация тривиально копируемых типов: элементы пишутся и читаются одним блоком байт
+ */
+template<typename T>
+struct Serializer<T, std::enable_if_t<std::is_trivially_copyable_v<T> && !std::is_pointer_v<T> &&
+                                      !std::is_same_v<T, std::string_view> &&
+                                      !std::is_same_v<T, InternedString> > > {
+    static constexpr uint32_t element_size = sizeof(T);
+
+    static void write_block(BinaryWriter &writer, const T *elements, const size_t count) {
+        writer.write(elements, count * sizeof(T));
+    }
+
+    static void read_block(BinaryReader &reader, T *elements, const size_t count, const bool is_swapped,
+                           StringArena &) {
+        if (is_swapped && !std::is_arithmetic_v<T>) {
+            throw std::runtime_error("Ошибка: файл записан с другим порядком байт.");
+        }
+        reader.read(elements, count * sizeof(T));
+        if (is_swapped) {
+            for (size_t i = 0; i < count; ++i) {
+                swap_bytes(&elements[i], sizeof(T));
+            }
+        }
+    }
+};
+
+/**
+ * @brief Общая часть сериализации строк
+ * блок вершины: uint64_t размер блока, uint32_t длины всех строк, затем байты всех строк подряд
+ */
+struct StringBlockSerializer {
+    static constexpr uint32_t element_size = 0;
+
+    template<typename S>
+    static void write_block(BinaryWriter &writer, const S *elements, const size_t count) {
+        std::vector<uint32_t> lengths(count);
+        uint64_t block_size = count * sizeof(uint32_t);
+        for (size_t i = 0; i < count; ++i) {
+            if (elements[i].size() > UINT32_MAX) {
+                throw std::runtime_error("Ошибка: строка слишком длинная для бинарного файла.");
+            }
+            lengths[i] = static_cast<uint32_t>(elements[i].size());
+            block_size += lengths[i];
+        }
+        writer.write_value(block_size);
+        writer.write(lengths.data(), lengths.size() * sizeof(uint32_t));
+        for (size_t i = 0; i < count; ++i) {
+            writer.write(elements[i].data(), elements[i].size());
+        }
+    }
+
+    /**
+     * @brief Функция читает длины строк блока и возвращает количество байт строк
+     */
+    static uint64_t read_lengths(BinaryReader &reader, std::vector<uint32_t> &lengths, const size_t count,
+                                 const bool is_swapped) {
+        auto block_size = reader.read_value<uint64_t>();
+        lengths.resize(count);
+        reader.read(lengths.data(), count * sizeof(uint32_t));
+        if (is_swapped) {
+            swap_bytes(&block_size, sizeof(block_size));
+            for (auto &length: lengths) {
+                swap_bytes(&length, sizeof(length));
+            }
+        }
+        uint64_t bytes = 0;
+        for (const auto length: lengths) {
+            bytes += length;
+        }
+        if (block_size != bytes + count * sizeof(uint32_t)) {
+            throw std::runtime_error("Ошибка: повреждён блок строк в бинарном файле.");
+        }
+        return bytes;
+    }
+};
+
+/**
+ * @brief Сериализация std::string: байты вершины читаются одним блоком во временный буфер, затем каждая строка
+ * копируется в свой std::string. Используется только для отдельных элементов (снимок с другим arr_size); вершины
+ * с тем же arr_size читаются сразу в упакованную вершину (LeafNode<std::string>::read_block)
+ */
+template<>
+struct Serializer<std::string> : StringBlockSerializer {
+    static void write_block(BinaryWriter &writer, const std::string *elements, const size_t count) {
+        StringBlockSerializer::write_block(writer, elements, count);
+    }
+
+    static void read_block(BinaryReader &reader, std::string *elements, const size_t count, const bool is_swapped,
+                           StringArena &) {
+        std::vector<uint32_t> lengths;
+        std::vector<char> bytes(read_lengths(reader, lengths, count, is_swapped));
+        reader.read(bytes.data(), bytes.size());
+        const char *position = bytes.data();
+        for (size_t i = 0; i < count; ++i) {
+            elements[i].assign(position, lengths[i]);
+            position += lengths[i];
+        }
+    }
+};
+
+/**
+ * @brief Сериализация std::string_view: байты вершины читаются в один блок области памяти дерева, и элементы
+ * ссылаются на него без копирования. Формат совпадает с std::string
+ */
+template<>
+struct Serializer<std::string_view> : StringBlockSerializer {
+    static void write_block(BinaryWriter &writer, const std::string_view *elements, const size_t count) {
+        StringBlockSerializer::write_block(writer, elements, count);
+    }
+
+    static void read_block(BinaryReader &reader, std::string_view *elements, const size_t count,
+                           const bool is_swapped, StringArena &arena) {
+        std::vector<uint32_t> lengths;
+        const uint64_t size = read_lengths(reader, lengths, count, is_swapped);
+        char *bytes = arena.allocate(size);
+        reader.read(bytes, size);
+        for (size_t i = 0; i < count; ++i) {
+            elements[i] = std::string_view(bytes, lengths[i]);
+            bytes += lengths[i];
+        }
+    }
+};
+
+/**
+ * @brief Сериализация InternedString: номера строк действительны только в процессе, поэтому пишутся сами строки
+ * в формате std::string, а при чтении строки снова интернируются
+ */
+template<>
+struct Serializer<InternedString> : StringBlockSerializer {
+    static void write_block(BinaryWriter &writer, const InternedString *elements, const size_t count) {
+        std::vector<std::string_view> views(count);
+        for (size_t i = 0; i < count; ++i) {
+            views[i] = elements[i].view();
+        }
+        StringBlockSerializer::write_block(writer, views.data(), count);
+    }
+
+    static void read_block(BinaryReader &reader, InternedString *elements, const size_t count,
+                           const bool is_swapped, StringArena &) {
+        std::vector<uint32_t> lengths;
+        std::vector<char> bytes(read_lengths(reader, lengths, count, is_swapped));
+        reader.read(bytes.data(), bytes.size());
+        const char *position = bytes.data();
+        for (size_t i = 0; i < count; ++i) {
+            elements[i] = InternedString(std::string_view(position, lengths[i]));
+            position += lengths[i];
+        }
+    }
+};
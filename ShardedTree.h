@@ -0,0 +1,277 @@
+#pragma once
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "Tree.h"
+
+/**
+ * PARTITION - способ распределения элементов по сегментам
+ *
+ * RANGE - сегменты хранят последовательные диапазоны логических номеров, порядок элементов сохраняется.
+ * insert без номера, как Tree::insert, добавляет элемент в конец, то есть в последний сегмент; параллельная запись
+ * в разные сегменты идёт через вставку и удаление по номеру
+ *
+ * HASH - элемент попадает в сегмент по хешу значения, используется для неупорядоченной загрузки. Вставка по
+ * номеру недоступна, потому что положила бы элемент не в сегмент его хеша
+ */
+enum class PARTITION { RANGE, HASH };
+
+/**
+ * @brief Класс сегментированного дерева для конкурентной записи
+ * @tparam T Тип хранимых данных
+ * @tparam arr_size Размер массива в конечной вершине
+ *
+ * Элементы распределены по нескольким независимым деревьям (сегментам), у каждого свой мьютекс и
+ * закэшированное количество элементов. Глобальный номер переводится в номер внутри сегмента по этим счётчикам.
+ * Операции по номеру блокируют сегменты по возрастанию до нужного, поэтому номера перед ним не меняются во время
+ * операции, а писатели в остальные сегменты продолжают работу параллельно.
+ */
+template<typename T, size_t arr_size>
+class ShardedTree {
+    struct Shard {
+        Tree<T, arr_size> tree;
+        mutable std::mutex mutex;
+        std::atomic<size_t> count{0};
+    };
+
+    std::vector<std::unique_ptr<Shard> > shards;
+
+    PARTITION partition;
+
+    size_t shard_for_value(const T &element) const;
+
+    size_t lock_prefix(size_t &index, bool is_insert, std::vector<std::unique_lock<std::mutex> > &locks) const;
+
+public:
+    explicit ShardedTree(size_t shard_count = std::thread::hardware_concurrency(),
+                         PARTITION partition = PARTITION::HASH);
+
+    size_t shard_count() const { return shards.size(); }
+
+    size_t size() const;
+
+    bool insert(const T &element);
+
+    bool remove(const T &element);
+
+    T get_by_index(size_t index) const;
+
+    T operator[](const size_t index) const { return get_by_index(index); }
+
+    bool insert_by_index(size_t index, const T &element);
+
+    bool remove_by_index(size_t index);
+
+    void for_each(const std::function<void(const T &)> &func) const;
+
+    void in_order_traversal(bool is_need_to_print) const;
+
+    void clear();
+
+    void rebalance();
+};
+
+template<typename T, size_t arr_size>
+ShardedTree<T, arr_size>::ShardedTree(size_t shard_count, const PARTITION partition):
+    partition(partition) {
+    if (shard_count == 0) {
+        shard_count = 1;
+    }
+    shards.reserve(shard_count);
+    for (size_t i = 0; i < shard_count; ++i) {
+        shards.push_back(std::make_unique<Shard>());
+    }
+}
+
+/**
+ * @brief Функция выбирает сегмент для значения при распределении по хешу
+ * @param element Значение
+ * @return Номер сегмента
+ */
+template<typename T, size_t arr_size>
+size_t ShardedTree<T, arr_size>::shard_for_value(const T &element) const {
+    return std::hash<T>{}(element) % shards.size();
+}
+
+/**
+ * @brief Функция блокирует сегменты по возрастанию, пока не найдёт сегмент с глобальным номером index
+ * порядок блокировки всегда один и тот же, поэтому взаимные блокировки невозможны
+ * @param index Глобальный номер, после вызова содержит номер внутри найденного сегмента
+ * @param is_insert true - если номер может указывать на конец сегмента (вставка на границе сегментов
+ * выполняется в конец левого из них)
+ * @param locks Вектор, в который складываются захваченные блокировки
+ * @return Номер сегмента
+ */
+template<typename T, size_t arr_size>
+size_t ShardedTree<T, arr_size>::lock_prefix(size_t &index, const bool is_insert,
+                                             std::vector<std::unique_lock<std::mutex> > &locks) const {
+    for (size_t i = 0; i < shards.size(); ++i) {
+        locks.emplace_back(shards[i]->mutex);
+        const size_t count = shards[i]->count.load(std::memory_order_relaxed);
+        if (index < count || (is_insert && index == count)) {
+            return i;
+        }
+        index -= count;
+    }
+    throw std::out_of_range("Index out of bounds");
+}
+
+/**
+ * @brief Функция возвращает количество элементов по закэшированным счётчикам сегментов
+ */
+template<typename T, size_t arr_size>
+size_t ShardedTree<T, arr_size>::size() const {
+    size_t total = 0;
+    for (const auto &shard: shards) {
+        total += shard->count.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+/**
+ * @brief Функция добавляет элемент
+ * блокируется только один сегмент: сегмент хеша значения или, при распределении по диапазонам, последний
+ * сегмент, в конец которого элемент добавляется, как в Tree::insert
+ * @param element Элемент который необходимо добавить
+ * @return true если добавление прошло успешно
+ */
+template<typename T, size_t arr_size>
+bool ShardedTree<T, arr_size>::insert(const T &element) {
+    Shard &shard = *shards[partition == PARTITION::HASH ? shard_for_value(element) : shards.size() - 1];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (!shard.tree.insert(element)) {
+        return false;
+    }
+    shard.count.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+/**
+ * @brief Функция удаляет все вхождения значения
+ * при распределении по хешу значение может находиться только в одном сегменте
+ * @param element Элемент который необходимо удалить
+ */
+template<typename T, size_t arr_size>
+bool ShardedTree<T, arr_size>::remove(const T &element) {
+    auto remove_from = [&](Shard &shard) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.tree.remove(element);
+        shard.count.store(shard.tree.size(), std::memory_order_relaxed);
+    };
+
+    if (partition == PARTITION::HASH) {
+        remove_from(*shards[shard_for_value(element)]);
+    } else {
+        for (auto &shard: shards) {
+            remove_from(*shard);
+        }
+    }
+    return true;
+}
+
+template<typename T, size_t arr_size>
+T ShardedTree<T, arr_size>::get_by_index(size_t index) const {
+    std::vector<std::unique_lock<std::mutex> > locks;
+    const size_t shard = lock_prefix(index, false, locks);
+    return shards[shard]->tree.get_by_index(index);
+}
+
+/**
+ * @brief Функция вставляет элемент перед элементом с глобальным номером index (только при распределении по
+ * диапазонам)
+ */
+template<typename T, size_t arr_size>
+bool ShardedTree<T, arr_size>::insert_by_index(size_t index, const T &element) {
+    if (partition == PARTITION::HASH) {
+        throw std::runtime_error("Ошибка: вставка по номеру недоступна при распределении по хешу.");
+    }
+    std::vector<std::unique_lock<std::mutex> > locks;
+    Shard &shard = *shards[lock_prefix(index, true, locks)];
+
+    const size_t count = shard.count.load(std::memory_order_relaxed);
+    const bool result = index == count ? shard.tree.insert(element) : shard.tree.insert_by_index(index, element);
+    if (result) {
+        shard.count.store(count + 1, std::memory_order_relaxed);
+    }
+    return result;
+}
+
+template<typename T, size_t arr_size>
+bool ShardedTree<T, arr_size>::remove_by_index(size_t index) {
+    std::vector<std::unique_lock<std::mutex> > locks;
+    Shard &shard = *shards[lock_prefix(index, false, locks)];
+
+    const bool result = shard.tree.remove_by_index(index);
+    if (result) {
+        shard.count.fetch_sub(1, std::memory_order_relaxed);
+    }
+    return result;
+}
+
+/**
+ * @brief Функция обходит элементы всех сегментов в порядке глобальной нумерации
+ * сегменты блокируются по очереди, поэтому обход не является мгновенным снимком всего дерева
+ * @param func Функция, вызываемая для каждого элемента
+ */
+template<typename T, size_t arr_size>
+void ShardedTree<T, arr_size>::for_each(const std::function<void(const T &)> &func) const {
+    for (const auto &shard: shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        shard->tree.for_each(func);
+    }
+}
+
+template<typename T, size_t arr_size>
+void ShardedTree<T, arr_size>::in_order_traversal(const bool is_need_to_print) const {
+    for_each([&](const T &element) {
+        if (is_need_to_print) {
+            std::cout << element << " ";
+        }
+    });
+}
+
+template<typename T, size_t arr_size>
+void ShardedTree<T, arr_size>::clear() {
+    for (auto &shard: shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        shard->tree.clear();
+        shard->count.store(0, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Функция выравнивает количество элементов в сегментах с сохранением глобального порядка, каждый сегмент
+ * строится одним append. При распределении по хешу каждый элемент уже лежит в сегменте своего хеша, и функция
+ * ничего не делает
+ */
+template<typename T, size_t arr_size>
+void ShardedTree<T, arr_size>::rebalance() {
+    if (partition == PARTITION::HASH) {
+        return;
+    }
+    std::vector<std::unique_lock<std::mutex> > locks;
+    std::vector<T> elements;
+    for (auto &shard: shards) {
+        locks.emplace_back(shard->mutex);
+        shard->tree.for_each([&](const T &element) { elements.push_back(element); });
+        shard->tree.clear();
+    }
+
+    const size_t per_shard = elements.size() / shards.size();
+    size_t remainder = elements.size() % shards.size();
+    auto it = elements.begin();
+    for (auto &shard: shards) {
+        const size_t count = per_shard + (remainder > 0 ? 1 : 0);
+        if (remainder > 0) {
+            --remainder;
+        }
+        shard->tree.append(std::vector<T>(it, it + static_cast<std::ptrdiff_t>(count)));
+        it += static_cast<std::ptrdiff_t>(count);
+        shard->count.store(count, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Класс области памяти для байтов строк, на которые ссылаются std::string_view в дереве
+ * память выделяется крупными блоками и освобождается только вместе с областью, поэтому представления остаются
+ * действительными, пока жива область. Крупные запросы (например, байты целой конечной вершины при загрузке)
+ * получают отдельный блок одной операцией выделения
+ */
+class StringArena {
+    static constexpr size_t BLOCK_SIZE = 1 << 16;
+
+    std::vector<std::unique_ptr<char[]> > blocks;
+    char *current = nullptr;
+    size_t left = 0;
+    size_t allocated = 0;
+
+public:
+    StringArena() = default;
+
+    StringArena(const StringArena &) = delete;
+
+    StringArena &operator=(const StringArena &) = delete;
+
+    char *allocate(const size_t size) {
+        allocated += size;
+        if (size > BLOCK_SIZE / 4) {
+            blocks.push_back(std::make_unique<char[]>(size));
+            return blocks.back().get();
+        }
+        if (size > left) {
+            blocks.push_back(std::make_unique<char[]>(BLOCK_SIZE));
+            current = blocks.back().get();
+            left = BLOCK_SIZE;
+        }
+        char *result = current;
+        current += size;
+        left -= size;
+        return result;
+    }
+
+    std::string_view store(const std::string_view text) {
+        if (text.empty()) {
+            return {};
+        }
+        char *bytes = allocate(text.size());
+        std::memcpy(bytes, text.data(), text.size());
+        return {bytes, text.size()};
+    }
+
+    /**
+     * @brief Функция освобождает все байты области, кроме текущего блока, который используется заново;
+     * представления на байты области становятся недействительными
+     */
+    void clear() {
+        std::unique_ptr<char[]> reused;
+        if (current) {
+            const char *start = current - (BLOCK_SIZE - left);
+            for (auto &block: blocks) {
+                if (block.get() == start) {
+                    reused = std::move(block);
+                }
+            }
+        }
+        blocks.clear();
+        allocated = 0;
+        current = reused.get();
+        left = reused ? BLOCK_SIZE : 0;
+        if (reused) {
+            blocks.push_back(std::move(reused));
+        }
+    }
+
+    size_t bytes_allocated() const { return allocated; }
+};
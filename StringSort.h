@@ -0,0 +1,100 @@
+#pragma once
+#include <cstddef>
+#include <string_view>
+#include <utility>
+
+/**
+ * @brief Сортировка строк многоключевой быстрой сортировкой (Бентли - Седжвик)
+ * строки делятся на три части по одному байту на позиции depth: меньше, равен и больше опорного. Меньшая и
+ * большая части сортируются с той же позиции, равная - со следующей, поэтому общий префикс каждой части
+ * сравнивается только один раз, а не в каждом сравнении, как у std::sort. Переставляются только представления
+ * (указатель и длина), байты строк не перемещаются. Порядок совпадает с operator< для std::string (байты
+ * сравниваются как unsigned char, префикс меньше продолжения)
+ */
+constexpr size_t STRING_SORT_INSERTION_THRESHOLD = 16;
+
+/**
+ * @brief Функция возвращает байт строки на позиции depth как unsigned char, -1 - если строка короче
+ */
+inline int string_sort_byte(const std::string_view text, const size_t depth) {
+    return depth < text.size() ? static_cast<unsigned char>(text[depth]) : -1;
+}
+
+/**
+ * @brief Функция сортирует вставками строки с общим префиксом длины depth
+ */
+inline void string_insertion_sort(std::string_view *elements, const size_t count, const size_t depth) {
+    for (size_t i = 1; i < count; ++i) {
+        const std::string_view element = elements[i];
+        const std::string_view suffix = element.substr(depth);
+        size_t j = i;
+        while (j > 0 && suffix < elements[j - 1].substr(depth)) {
+            elements[j] = elements[j - 1];
+            --j;
+        }
+        elements[j] = element;
+    }
+}
+
+/**
+ * @brief Функция сортирует строки с общим префиксом длины depth
+ * рекурсия идёт в две меньшие из трёх частей, самая большая сортируется в том же вызове, поэтому глубина
+ * рекурсии не больше log2(count) при любых длинах общих префиксов
+ * @param elements Строки
+ * @param count Количество строк
+ * @param depth Длина общего префикса
+ */
+inline void multikey_sort(std::string_view *elements, size_t count, size_t depth = 0) {
+    while (count > STRING_SORT_INSERTION_THRESHOLD) {
+        int a = string_sort_byte(elements[0], depth);
+        int b = string_sort_byte(elements[count / 2], depth);
+        int c = string_sort_byte(elements[count - 1], depth);
+        if (a > b) {
+            std::swap(a, b);
+        }
+        if (b > c) {
+            b = a > c ? a : c;
+        }
+        const int pivot = b;
+
+        size_t less = 0;
+        size_t greater = count;
+        for (size_t i = 0; i < greater;) {
+            const int byte = string_sort_byte(elements[i], depth);
+            if (byte < pivot) {
+                std::swap(elements[less++], elements[i++]);
+            } else if (byte > pivot) {
+                std::swap(elements[i], elements[--greater]);
+            } else {
+                ++i;
+            }
+        }
+
+        struct Range {
+            std::string_view *elements;
+            size_t count;
+            size_t depth;
+        };
+        // строки, которые закончились на depth, равны между собой и уже на месте
+        Range parts[3] = {
+            {elements, less, depth},
+            {elements + less, pivot < 0 ? 0 : greater - less, depth + 1},
+            {elements + greater, count - greater, depth}
+        };
+        size_t largest = 0;
+        for (size_t i = 1; i < 3; ++i) {
+            if (parts[i].count > parts[largest].count) {
+                largest = i;
+            }
+        }
+        for (size_t i = 0; i < 3; ++i) {
+            if (i != largest) {
+                multikey_sort(parts[i].elements, parts[i].count, parts[i].depth);
+            }
+        }
+        elements = parts[largest].elements;
+        count = parts[largest].count;
+        depth = parts[largest].depth;
+    }
+    string_insertion_sort(elements, count, depth);
+}
@@ -0,0 +1,302 @@
+#pragma once
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <istream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "InternTable.h"
+#include "StringArena.h"
+
+/**
+ * Чтение текстового формата дерева (см. operator<< в Tree.h)
+ *
+ * Файл состоит из строк "LeafNode: e1 e2 ...", "IntermediateNode" и "Empty tree", значение имеют только элементы
+ * строк LeafNode. TextLineReader читает поток блоками по TEXT_BLOCK_SIZE байт и выдаёт строки как указатели в
+ * свой буфер без копирования, for_each_token делит строку на слова по пробельным символам (по 16 байт за раз
+ * через маски SSE2/NEON, см. text_space_mask), parse_text_element разбирает слово: числа - std::from_chars,
+ * строки - без промежуточных потоков, остальные типы - через operator>> как раньше
+ *
+ * Запись (Tree::save_to_text) форматирует элементы функцией append_text_element прямо в большой строковый буфер:
+ * числа - std::to_chars, строки копируются как есть, остальные типы - через operator<<. Буфер пишется в поток
+ * блоками не меньше TEXT_BLOCK_SIZE байт
+ */
+constexpr size_t TEXT_BLOCK_SIZE = 1 << 20;
+
+constexpr std::string_view TEXT_LEAF_PREFIX = "LeafNode:";
+
+/**
+ * @brief Способ деления обычного текстового файла на элементы (см. Tree::load_tokens_from_file)
+ */
+enum class TEXT_SPLIT { WORDS, LINES };
+
+/**
+ * @brief Класс построчного чтения потока крупными блоками
+ * строка, не поместившаяся в остаток блока, переносится в начало буфера перед чтением следующего блока; строки
+ * длиннее буфера увеличивают буфер
+ */
+class TextLineReader {
+    std::istream &is;
+    std::vector<char> buffer;
+    size_t begin = 0;
+    size_t end = 0;
+    bool is_eof = false;
+
+    void fill() {
+        if (begin > 0) {
+            std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+            end -= begin;
+            begin = 0;
+        }
+        if (end == buffer.size()) {
+            buffer.resize(buffer.size() * 2);
+        }
+        is.read(buffer.data() + end, static_cast<std::streamsize>(buffer.size() - end));
+        const auto count = static_cast<size_t>(is.gcount());
+        end += count;
+        is_eof = count == 0;
+    }
+
+public:
+    explicit TextLineReader(std::istream &is, const size_t block_size = TEXT_BLOCK_SIZE)
+        : is(is), buffer(block_size == 0 ? 1 : block_size) {
+    }
+
+    /**
+     * @brief Функция выдаёт следующую строку без символа перевода строки
+     * @param line Строка, действительна до следующего вызова
+     * @return false - если строки закончились
+     */
+    bool next_line(std::string_view &line) {
+        size_t scanned = 0;
+        while (true) {
+            if (const void *newline = std::memchr(buffer.data() + begin + scanned, '\n', end - begin - scanned)) {
+                const size_t position = static_cast<const char *>(newline) - buffer.data();
+                line = std::string_view(buffer.data() + begin, position - begin);
+                begin = position + 1;
+                return true;
+            }
+            if (is_eof) {
+                if (begin == end) {
+                    return false;
+                }
+                line = std::string_view(buffer.data() + begin, end - begin);
+                begin = end;
+                return true;
+            }
+            scanned = end - begin;
+            fill();
+        }
+    }
+};
+
+inline bool is_text_space(const char symbol) {
+    return symbol == ' ' || symbol == '\t' || symbol == '\r' || symbol == '\v' || symbol == '\f';
+}
+
+constexpr size_t TEXT_MASK_WIDTH = 16;
+
+/**
+ * @brief Функция возвращает маску пробельных символов (см. is_text_space) в TEXT_MASK_WIDTH байтах: бит i
+ * установлен, если data[i] - пробельный символ. Байты сравниваются одной командой на все 16 байт (SSE2 на x86,
+ * NEON на AArch64), на остальных платформах - по одному
+ * @param data Начало 16 байт
+ */
+inline uint32_t text_space_mask(const char *data) {
+#if defined(__SSE2__)
+    const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+    __m128i spaces = _mm_cmpeq_epi8(bytes, _mm_set1_epi8(' '));
+    spaces = _mm_or_si128(spaces, _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\t')));
+    spaces = _mm_or_si128(spaces, _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\r')));
+    spaces = _mm_or_si128(spaces, _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\v')));
+    spaces = _mm_or_si128(spaces, _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\f')));
+    return static_cast<uint32_t>(_mm_movemask_epi8(spaces));
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    const uint8x16_t bytes = vld1q_u8(reinterpret_cast<const uint8_t *>(data));
+    uint8x16_t spaces = vceqq_u8(bytes, vdupq_n_u8(' '));
+    spaces = vorrq_u8(spaces, vceqq_u8(bytes, vdupq_n_u8('\t')));
+    spaces = vorrq_u8(spaces, vceqq_u8(bytes, vdupq_n_u8('\r')));
+    spaces = vorrq_u8(spaces, vceqq_u8(bytes, vdupq_n_u8('\v')));
+    spaces = vorrq_u8(spaces, vceqq_u8(bytes, vdupq_n_u8('\f')));
+    // у NEON нет movemask: каждый байт оставляет свой бит, и биты половин складываются
+    static constexpr uint8_t weights[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    const uint8x16_t bits = vandq_u8(spaces, vld1q_u8(weights));
+    return vaddv_u8(vget_low_u8(bits)) | static_cast<uint32_t>(vaddv_u8(vget_high_u8(bits))) << 8;
+#else
+    uint32_t mask = 0;
+    for (size_t i = 0; i < TEXT_MASK_WIDTH; ++i) {
+        mask |= static_cast<uint32_t>(is_text_space(data[i])) << i;
+    }
+    return mask;
+#endif
+}
+
+/**
+ * @brief Функция возвращает номер младшего установленного бита ненулевой маски
+ */
+inline uint32_t lowest_bit(const uint32_t mask) {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<uint32_t>(__builtin_ctz(mask));
+#else
+    uint32_t bit = 0;
+    while (!(mask >> bit & 1)) {
+        ++bit;
+    }
+    return bit;
+#endif
+}
+
+/**
+ * @brief Функция вызывает func для каждого слова строки, пока func возвращает true
+ * строка классифицируется блоками по TEXT_MASK_WIDTH байт: границы слов находятся по младшим битам маски
+ * пробельных символов и её дополнения, поэтому на блок приходится одно сравнение независимо от длины слов.
+ * Остаток строки короче блока копируется в буфер, дополненный пробелами
+ * @param line Строка
+ * @param func Функция, получающая слово как std::string_view
+ */
+template<typename Func>
+void for_each_token(const std::string_view line, Func &&func) {
+    const char *const data = line.data();
+    const size_t size = line.size();
+    constexpr uint32_t full_mask = (uint64_t{1} << TEXT_MASK_WIDTH) - 1;
+
+    size_t token = 0;
+    bool is_in_token = false;
+    char tail[TEXT_MASK_WIDTH];
+    for (size_t base = 0; base < size; base += TEXT_MASK_WIDTH) {
+        uint32_t spaces;
+        if (size - base >= TEXT_MASK_WIDTH) {
+            spaces = text_space_mask(data + base);
+        } else {
+            std::memset(tail, ' ', sizeof(tail));
+            std::memcpy(tail, data + base, size - base);
+            spaces = text_space_mask(tail);
+        }
+
+        // биты, которые ещё не просмотрены в этом блоке
+        uint32_t unseen = full_mask;
+        while (true) {
+            const uint32_t boundary = (is_in_token ? spaces : ~spaces) & unseen;
+            if (boundary == 0) {
+                break;
+            }
+            const uint32_t bit = lowest_bit(boundary);
+            if (is_in_token) {
+                if (!func(std::string_view(data + token, base + bit - token))) {
+                    return;
+                }
+            } else {
+                token = base + bit;
+            }
+            is_in_token = !is_in_token;
+            unseen = full_mask & ~((uint32_t{2} << bit) - 1);
+        }
+    }
+    if (is_in_token) {
+        func(std::string_view(data + token, size - token));
+    }
+}
+
+/**
+ * @brief Функция разбирает одно слово в элемент
+ * @param token Слово
+ * @param element Результат
+ * @param arena Область памяти для байтов строк, на которые ссылается результат (std::string_view, char*);
+ * InternedString хранит байты в таблице строк
+ * @return false - если слово не является значением типа T
+ */
+template<typename T>
+bool parse_text_element(const std::string_view token, T &element, StringArena &arena) {
+    if constexpr ((std::is_integral_v<T> && !std::is_same_v<T, bool> && sizeof(T) > 1) ||
+                  std::is_floating_point_v<T>) {
+        const char *begin = token.data();
+        const char *const end = token.data() + token.size();
+        if (begin != end && *begin == '+') {
+            ++begin;
+        }
+#if !defined(__cpp_lib_to_chars)
+        // стандартная библиотека без std::from_chars для чисел с плавающей точкой (libc++ до 20 версии)
+        if constexpr (std::is_floating_point_v<T>) {
+            const std::string copy(begin, end);
+            char *position = nullptr;
+            element = static_cast<T>(std::strtold(copy.c_str(), &position));
+            return !copy.empty() && position == copy.c_str() + copy.size();
+        } else
+#endif
+        {
+            const auto [position, error] = std::from_chars(begin, end, element);
+            return error == std::errc() && position == end;
+        }
+    } else if constexpr (std::is_same_v<T, std::string>) {
+        element.assign(token.data(), token.size());
+        return true;
+    } else if constexpr (std::is_same_v<T, std::string_view>) {
+        element = arena.store(token);
+        return true;
+    } else if constexpr (std::is_same_v<T, InternedString>) {
+        element = InternedString(token);
+        return true;
+    } else if constexpr (std::is_same_v<T, char *> || std::is_same_v<T, const char *>) {
+        char *bytes = arena.allocate(token.size() + 1);
+        std::memcpy(bytes, token.data(), token.size());
+        bytes[token.size()] = '\0';
+        element = bytes;
+        return true;
+    } else {
+        std::istringstream iss{std::string(token)};
+        return static_cast<bool>(iss >> element) && iss.peek() == std::char_traits<char>::eof();
+    }
+}
+
+/**
+ * @brief Функция дописывает текстовое представление элемента в конец буфера
+ * числа с плавающей точкой записываются кратчайшей записью, которая читается обратно в то же значение
+ * @param out Буфер
+ * @param element Элемент
+ */
+template<typename T>
+void append_text_element(std::string &out, const T &element) {
+    if constexpr ((std::is_integral_v<T> && !std::is_same_v<T, bool> && sizeof(T) > 1) ||
+                  std::is_floating_point_v<T>) {
+        char digits[64];
+#if !defined(__cpp_lib_to_chars)
+        // стандартная библиотека без std::to_chars для чисел с плавающей точкой
+        if constexpr (std::is_floating_point_v<T>) {
+            const int length = std::snprintf(digits, sizeof(digits), "%.*Lg", std::numeric_limits<T>::max_digits10,
+                                             static_cast<long double>(element));
+            out.append(digits, static_cast<size_t>(length));
+        } else
+#endif
+        {
+            const auto result = std::to_chars(digits, digits + sizeof(digits), element);
+            out.append(digits, result.ptr);
+        }
+    } else if constexpr (std::is_same_v<T, char> || std::is_same_v<T, signed char> ||
+                         std::is_same_v<T, unsigned char>) {
+        out.push_back(static_cast<char>(element));
+    } else if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>) {
+        out.append(element.data(), element.size());
+    } else if constexpr (std::is_same_v<T, InternedString>) {
+        const std::string_view text = element.view();
+        out.append(text.data(), text.size());
+    } else if constexpr (std::is_same_v<T, char *> || std::is_same_v<T, const char *>) {
+        out.append(element);
+    } else {
+        std::ostringstream os;
+        os << element;
+        out += os.str();
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <cstring>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Класс поиска образца в блоке байт (алгоритм Бойера - Мура - Хорспула)
+ * кандидаты на начало вхождения находятся функцией memchr по первому байту образца (в стандартной библиотеке
+ * она векторизована), у кандидата сначала сравнивается последний байт, затем весь образец. При несовпадении
+ * сдвиг берётся из таблицы по байту текста под последним байтом образца и снова ищется первый байт, поэтому
+ * оба пропуска безопасны: вхождение не может начинаться с другого байта и не может попасть под сдвиг таблицы.
+ *
+ * Поиск по дереву (см. Tree::find) идёт по конечным вершинам без склейки текста, вхождения на границах вершин
+ * ищутся в окне из последних size() - 1 байт предыдущих вершин и первых size() - 1 байт следующей
+ */
+class TextSearcher {
+    std::string pattern;
+    size_t shift[256];
+
+public:
+    explicit TextSearcher(const std::string_view pattern) : pattern(pattern) {
+        const size_t length = pattern.size();
+        for (auto &value: shift) {
+            value = length == 0 ? 1 : length;
+        }
+        for (size_t i = 0; i + 1 < length; ++i) {
+            shift[static_cast<unsigned char>(pattern[i])] = length - 1 - i;
+        }
+    }
+
+    size_t size() const { return pattern.size(); }
+
+    /**
+     * @brief Функция ищет первое вхождение образца, начинающееся не раньше from
+     * @param data Начало блока
+     * @param size Размер блока
+     * @param from Позиция, с которой начинается поиск
+     * @return Позиция вхождения или std::string::npos, если вхождений нет (и для пустого образца)
+     */
+    size_t find(const char *data, const size_t size, size_t from = 0) const {
+        const size_t length = pattern.size();
+        if (length == 0 || size < length) {
+            return std::string::npos;
+        }
+        const char first = pattern.front();
+        const char last = pattern.back();
+        const size_t end = size - length + 1;
+
+        while (from < end) {
+            const void *candidate = std::memchr(data + from, first, end - from);
+            if (!candidate) {
+                return std::string::npos;
+            }
+            from = static_cast<const char *>(candidate) - data;
+            const char tail = data[from + length - 1];
+            if (tail == last && std::memcmp(data + from, pattern.data(), length - 1) == 0) {
+                return from;
+            }
+            from += shift[static_cast<unsigned char>(tail)];
+        }
+        return std::string::npos;
+    }
+};
@@ -1,18 +1,86 @@
 #pragma once
+#include <cstdio>
+#include <future>
 #include <iostream>
+#include <queue>
+#include <thread>
+#include "BinaryFormat.h"
+#include "DeltaCodec.h"
+#include "MappedFile.h"
 #include "Nodes.h"
+#include "TextSearch.h"
+#include "Serializer.h"
+#include "StringArena.h"
+#include "StringSort.h"
+#include "TextIO.h"
+
+/**
+ * @brief Функция подсказывает процессору заранее загрузить память в кэш
+ * @param address Адрес, к которому скоро будет обращение
+ */
+inline void prefetch(const void *address) {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(address);
+#endif
+}
+
+/**
+ * OPERATION - тип изменения в пакете для Tree::apply_batch
+ *
+ * INSERT - добавление элемента в конец
+ *
+ * INSERT_BY_INDEX - включение элемента перед элементом с заданным номером
+ *
+ * REMOVE - удаление всех элементов с заданным значением
+ *
+ * REMOVE_BY_INDEX - удаление элемента с заданным номером
+ */
+enum class OPERATION { INSERT, INSERT_BY_INDEX, REMOVE, REMOVE_BY_INDEX };
+
+/**
+ * @brief Структура одного изменения в пакете
+ * @tparam T Тип хранимых данных
+ *
+ * номера во всех изменениях пакета относятся к дереву до применения пакета
+ */
+template<typename T>
+struct Operation {
+    OPERATION type;
+    size_t index = 0;
+    T value{};
+};
 
 
 /**
  * @brief Класс дерево, в нём реализованы все метода для работы
  * @tparam T Тип хранимых данных
  * @tparam arr_size Размер массива в конечной вершине
+ *
+ * Копии дерева разделяют вершины до первого изменения (копирование при записи): изменение спускается от корня
+ * и копирует каждую вершину на пути, на которую есть ещё ссылки (см. unshared), поэтому копия остаётся
+ * неизменной и её можно читать из другого потока, пока исходное дерево продолжает изменяться
+ *
+ * Дерево символов Tree<char, N> служит текстовым буфером (rope): insert_text, erase_text и substr работают с
+ * диапазонами позиций за O(log n + длина диапазона), а промежуточные вершины хранят количество переводов строки
+ * в поддереве, поэтому переход между номером строки и позицией (line_to_offset, offset_to_line) занимает
+ * O(log n + arr_size). find и find_all ищут подстроку по конечным вершинам без склейки текста (см. TextSearcher)
+ *
+ * @tparam Compare Порядок элементов для sort, insert_with_order_save, lower_bound и удаления по значению в
+ * apply_batch. Если Compare прозрачный (есть Compare::is_transparent, как у std::less<>), lower_bound и remove
+ * принимают ключ любого сравнимого типа без создания T, например std::string_view для дерева std::string. Строки
+ * std::string лежат в вершинах упакованными, поэтому для этого дерева Compare сравнивает std::string_view.
+ * remove с порядком по умолчанию удаляет равные элементы (operator==, для char* - по содержимому строк), с другим
+ * порядком - эквивалентные
  */
-template<typename T, int arr_size>
+template<typename T, int arr_size, typename Compare = std::less<>>
 class Tree final {
+    template<typename, size_t>
+    friend class CheckpointFile;
+
     std::shared_ptr<TreeNode<T>> root;
 
-    void traverse(const std::shared_ptr<TreeNode<T>> &root, const std::function<void(std::shared_ptr<TreeNode<T>>)> &func);
+    void traverse(const std::shared_ptr<TreeNode<T>> &root,
+                  const std::function<void(std::shared_ptr<TreeNode<T>>)> &func) const;
 
     bool insert_helper(std::shared_ptr<TreeNode<T>> &node, const T &element);
 
@@ -22,80 +90,235 @@ class Tree final {
 
     size_t count_leaf_nodes(const std::shared_ptr<TreeNode<T>> &node) const;
 
+    size_t recount(const std::shared_ptr<TreeNode<T>> &node);
+
+    void get_many_sorted(const size_t *indices, size_t count, T *out) const;
+
+    template<typename It>
     void distribute_elements(const std::shared_ptr<TreeNode<T>> &node,
-                             typename std::vector<T>::iterator &it,
+                             It &it,
                              size_t elements_per_leaf,
                              size_t &remaining_elements);
 
+    template<typename It>
+    void rewrite_sorted(It elements, size_t total_elements);
+
+    void sort_strings();
+
+    void sort_interned();
+
+    /**
+     * @brief Функция сравнивает значения порядком Compare. Строки дерева std::string читаются из вершин как
+     * std::string_view; если Compare их не принимает (например, сравнивает const std::string &), представления
+     * копируются в std::string
+     */
+    template<typename Left, typename Right>
+    bool less(const Left &left, const Right &right) const {
+        if constexpr (std::is_invocable_r_v<bool, const Compare &, const Left &, const Right &>) {
+            return compare(left, right);
+        } else {
+            return compare(comparable(left), comparable(right));
+        }
+    }
+
+    template<typename Value>
+    static decltype(auto) comparable(const Value &value) {
+        if constexpr (std::is_same_v<Value, std::string_view>) {
+            return std::string(value);
+        } else {
+            return (value);
+        }
+    }
+
+    template<typename Key>
+    bool goes_left(const std::shared_ptr<IntermediateNode<T, arr_size>> &node, const Key &key) const;
+
+    template<typename Key>
+    size_t lower_bound_helper(const Key &key) const;
+
+    template<typename Element, typename Key>
+    bool equivalent(const Element &element, const Key &key) const;
+
+    template<typename Left, typename Right>
+    bool removal_less(const Left &left, const Right &right) const;
+
+    template<typename Key>
+    bool remove_equivalent(const Key &key);
+
+    template<typename Key>
+    std::shared_ptr<TreeNode<T>> remove_equivalent_helper(const std::shared_ptr<TreeNode<T>> &node, const Key &key,
+                                                          bool is_exclusive);
+
     std::vector<T> get_all_elements();
 
+    void build_from_elements(const std::vector<T> &elements);
+
+    std::shared_ptr<TreeNode<T>> build_subtree(const std::vector<T> &elements) const;
+
+    std::shared_ptr<TreeNode<T>> append_helper(const std::shared_ptr<TreeNode<T>> &node,
+                                               const std::shared_ptr<TreeNode<T>> &subtree);
+
+    std::shared_ptr<TreeNode<T>> build_helper(const std::vector<std::shared_ptr<TreeNode<T>>> &nodes,
+                                              size_t begin, size_t end) const;
+
+    std::shared_ptr<TreeNode<T>> join(const std::shared_ptr<TreeNode<T>> &left,
+                                      const std::shared_ptr<TreeNode<T>> &right) const;
+
+    std::shared_ptr<TreeNode<T>> balanced(const std::shared_ptr<TreeNode<T>> &left,
+                                          const std::shared_ptr<TreeNode<T>> &right) const;
+
+    std::shared_ptr<TreeNode<T>> make_intermediate(const std::shared_ptr<TreeNode<T>> &left,
+                                                   const std::shared_ptr<TreeNode<T>> &right) const;
+
+    // изменение по номеру в пакете apply_batch: номер в дереве до пакета и номер изменения в пакете
+    struct BatchOperation {
+        size_t index;
+        size_t sequence;
+        bool is_insert;
+        const T *value;
+    };
+
+    // удаления по значению пакета: значение и номер последнего удаления с этим значением
+    using RemovedValues = std::vector<std::pair<T, size_t>>;
+
+    template<typename Element>
+    bool is_batch_removed(const RemovedValues &removed_values, const Element &value, size_t sequence) const;
+
+    std::shared_ptr<TreeNode<T>> apply_batch_helper(const std::shared_ptr<TreeNode<T>> &node, size_t offset,
+                                                    const BatchOperation *begin, const BatchOperation *end,
+                                                    const RemovedValues &removed_values);
+
     /**
-     * @brief Функция для сохранения дерева в текстовый файл работает через оператор '<<'
-     * реализация написана в теле класса из-за особенностей реализации
+     * @brief Функция для сохранения дерева в текстовый файл работает через оператор '<<', см. save_to_text
      * @param os Поток вывода данных
      * @param tree Указатель на класс дерева
      * @return Возвращает поток данных для сохранения в файл
      */
     friend std::ostream &operator<<(std::ostream &os, Tree &tree) {
-        if (!tree.root) {
-            os << "Empty tree\n";
-            return os;
-        }
-        tree.traverse(tree.root, [&](const std::shared_ptr<TreeNode<T>> &node) {
-            if (node->get_type() == TYPE::LEAF) {
-                auto leaf = std::dynamic_pointer_cast<LeafNode<T, arr_size> >(node);
-                os << "LeafNode: ";
-                for (size_t i = 0; i < leaf->get_size(); ++i) {
-                    os << leaf->get_element_at(i) << " ";
-                }
-                os << "\n";
-            } else if (node->get_type() == TYPE::INTERMEDIATE) {
-                os << "IntermediateNode\n";
-            }
-        });
+        tree.save_to_text(os);
         return os;
     }
 
+    void format_text(const std::vector<TreeNode<T> *> &nodes, size_t begin, size_t end, std::string &out) const;
+
+    template<typename ParseLine>
+    std::vector<std::shared_ptr<TreeNode<T>>> parse_text_parts(std::string_view text, size_t threads,
+                                                               ParseLine parse_line) const;
+
+    // элемент блока при разборе текста: строки std::string копируются сразу в массив байт конечной вершины
+    // (см. LeafNode<std::string>), поэтому до этого хранятся как представления
+    using TextElement = std::conditional_t<std::is_same_v<T, std::string>, std::string_view, T>;
+
+    void parse_text(std::string_view line, std::vector<TextElement> &block,
+                    std::vector<std::shared_ptr<TreeNode<T>>> &leaves, StringArena *strings) const;
+
+    static bool parse_token(std::string_view token, TextElement &element, StringArena *strings);
+
+    void add_text_element(TextElement element, std::vector<TextElement> &block,
+                          std::vector<std::shared_ptr<TreeNode<T>>> &leaves) const;
+
+    void flush_text_block(std::vector<TextElement> &block, std::vector<std::shared_ptr<TreeNode<T>>> &leaves) const;
+
     /**
-     * @brief Функция для чтения дерева из текстового файла
+     * @brief Функция для чтения дерева из текстового файла, работает через load_from_text
      * @param is Поток входных данных
      * @param tree Указатель на дерево
      * @return Поток данных для вывода
      */
     friend std::istream &operator>>(std::istream &is, Tree &tree) {
-        tree.root = nullptr;
-        std::string line;
-
-        std::vector<T> elements;
-        while (std::getline(is, line)) {
-            std::istringstream iss(line);
-            std::string type;
-            iss >> type;
-            if (type == "LeafNode:") {
-                T element;
-                while (iss >> element) {
-                    tree.insert(element);
-                }
-            }
-        }
-        for (size_t i = 0; i < elements.size(); ++i) {
-            std::cout << elements[i] << " ";
-        }
+        tree.load_from_text(is);
         return is;
     }
 
     void clear_with_struct();
 
-    T get_by_index_helper(std::shared_ptr<TreeNode<T>> node, size_t index);
+    T get_by_index_helper(std::shared_ptr<TreeNode<T>> node, size_t index) const;
+
+    std::shared_ptr<TreeNode<T>> clone_helper(const std::shared_ptr<TreeNode<T>> &node) const;
+
+    std::shared_ptr<TreeNode<T>> unshared(const std::shared_ptr<TreeNode<T>> &node) const;
+
+    std::shared_ptr<TreeNode<T>> copied(const std::shared_ptr<TreeNode<T>> &node) const;
+
+    void unshare(std::shared_ptr<TreeNode<T>> &node) const { node = unshared(node); }
+
+    void unshare_all(std::shared_ptr<TreeNode<T>> &node) const;
+
+    void load_from_binary_file_v1(std::ifstream &ifs);
+
+    void load_from_binary_file_v2(std::ifstream &ifs);
 
     bool isTreeSorted = false;
 
+    Compare compare;
+
+    // байты строк, на которые ссылаются элементы std::string_view; разделяется копиями дерева из clone()
+    std::shared_ptr<StringArena> arena;
+
+    StringArena &get_arena() {
+        if (!arena) {
+            arena = std::make_shared<StringArena>();
+        }
+        return *arena;
+    }
+
+    // отображённый в память текстовый файл, на байты которого ссылаются элементы std::string_view после
+    // load_from_text_file и load_tokens_from_file; разделяется копиями дерева
+    std::shared_ptr<const MappedFile> mapping;
+
+    /**
+     * @brief Функция возвращает элемент, который можно хранить в дереве: байты добавляемых std::string_view
+     * копируются в область памяти дерева, потому что дерево не знает, сколько живут байты вызывающего
+     */
+    T stored(const T &element) {
+        if constexpr (std::is_same_v<T, std::string_view>) {
+            return get_arena().store(element);
+        } else {
+            return element;
+        }
+    }
+
+    // файл подкачки конечных вершин (см. enable_paging), разделяется копиями дерева
+    std::shared_ptr<LeafPager<T, arr_size>> pager;
+
+    std::shared_ptr<LeafNode<T, arr_size>> make_leaf() const {
+        return std::make_shared<LeafNode<T, arr_size>>(pager);
+    }
+
+    void page_leaves(std::shared_ptr<TreeNode<T>> &node) const;
+
+    std::shared_ptr<TreeNode<T>> insert_text_helper(std::shared_ptr<TreeNode<T>> node, size_t offset,
+                                                    std::string_view text) const;
+
+    std::shared_ptr<TreeNode<T>> erase_text_helper(std::shared_ptr<TreeNode<T>> node, size_t offset,
+                                                   size_t count) const;
+
+    std::shared_ptr<TreeNode<T>> text_leaves(std::string_view text) const;
+
+    std::shared_ptr<TreeNode<T>> join_text(const std::shared_ptr<TreeNode<T>> &left,
+                                           const std::shared_ptr<TreeNode<T>> &right) const;
+
+    static std::shared_ptr<LeafNode<T, arr_size>> edge_leaf(std::shared_ptr<TreeNode<T>> node, bool is_first);
+
+    std::shared_ptr<TreeNode<T>> without_edge_leaf(const std::shared_ptr<TreeNode<T>> &node, bool is_first) const;
+
+    void substr_helper(TreeNode<T> *node, size_t offset, size_t count, std::string &out) const;
+
+    template<typename Func>
+    bool scan_leaves(TreeNode<T> *node, size_t node_offset, size_t begin, size_t end, Func &func) const;
+
+    template<typename Report>
+    void search_range(const TextSearcher &searcher, size_t begin, size_t end, size_t limit, Report report) const;
+
     bool insert_with_order_helper(std::shared_ptr<TreeNode<T>> &node, const T &element);
 
 public:
     Tree(): root(nullptr) {
     }
 
+    explicit Tree(Compare compare): root(nullptr), compare(std::move(compare)) {
+    }
+
     void in_order_traversal(bool);
 
     ~Tree() = default;
@@ -104,23 +327,65 @@ public:
 
     bool remove(const T &element);
 
-    T get_by_index(size_t index);
+    template<typename Key, typename C = Compare, typename = typename C::is_transparent>
+    bool remove(const Key &key);
+
+    T get_by_index(size_t index) const;
+
+    void get_many(const size_t *indices, size_t count, T *out) const;
+
+    std::vector<T> get_many(const std::vector<size_t> &indices) const;
+
+    size_t size() const { return root ? root->get_size() : 0; }
+
+    // количество уровней промежуточных вершин над самой глубокой конечной вершиной
+    size_t height() const { return root ? root->get_height() : 0; }
+
+    size_t leaf_count() const { return count_leaf_nodes(root); }
+
+    void for_each(const std::function<void(const T &)> &func) const;
+
+    Tree clone() const;
 
     T operator[](int index);
 
     bool sort();
 
-    void save_to_binary_file(std::ofstream &ofs);
+    size_t lower_bound(const T &element) const;
+
+    template<typename Key, typename C = Compare, typename = typename C::is_transparent>
+    size_t lower_bound(const Key &key) const;
+
+    const Compare &get_compare() const { return compare; }
+
+    size_t compress_prefixes();
+
+    void save_to_binary_file(std::ofstream &ofs, ENCODING encoding = ENCODING::RAW);
+
+    std::future<void> save_async(const std::string &path, ENCODING encoding = ENCODING::RAW) const;
 
     void load_from_binary_file(std::ifstream &ifs);
 
+    void load_from_text(std::istream &is);
+
+    void load_from_text_file(const std::string &path, size_t threads = std::thread::hardware_concurrency());
+
+    void load_tokens_from_file(const std::string &path, TEXT_SPLIT split = TEXT_SPLIT::WORDS,
+                               size_t threads = std::thread::hardware_concurrency());
+
+    void save_to_text(std::ostream &os, size_t threads = 1) const;
+
     void print_helper();
 
     void print_tree() {
         print_helper();
     }
 
-    void clear() { root = nullptr; }
+    void clear() {
+        root = nullptr;
+        arena = nullptr;
+        mapping = nullptr;
+    }
 
     bool insert_by_index(size_t index, const T &element);
 
@@ -128,6 +393,34 @@ public:
 
     bool insert_with_order_save(T element);
 
+    bool apply_batch(const std::vector<Operation<T>> &operations);
+
+    void balance();
+
+    bool append(const std::vector<T> &elements);
+
+    void build_from_leaves(const std::vector<std::shared_ptr<TreeNode<T>>> &leaves);
+
+    void enable_paging(const std::string &path, size_t resident_leaves);
+
+    const LeafPager<T, arr_size> *get_pager() const { return pager.get(); }
+
+    void insert_text(size_t offset, std::string_view text);
+
+    void erase_text(size_t offset, size_t count);
+
+    std::string substr(size_t offset, size_t count) const;
+
+    size_t line_count() const { return root ? root->get_newline_count() + 1 : 1; }
+
+    size_t line_to_offset(size_t line) const;
+
+    size_t offset_to_line(size_t offset) const;
+
+    size_t find(std::string_view pattern, size_t from = 0) const;
+
+    std::vector<size_t> find_all(std::string_view pattern, size_t threads = 1) const;
+
 };
 
 /**
@@ -135,9 +428,9 @@ public:
  * @param root Указатель на вершину дерева
  * @param func Указатель на функцию для того, чтобы её можно было переиспользовать
  */
-template<typename T, int arr_size>
-void Tree<T, arr_size>::traverse(const std::shared_ptr<TreeNode<T>> &root,
-                                 const std::function<void(std::shared_ptr<TreeNode<T>>)> &func) {
+template<typename T, int arr_size, typename Compare>
+void Tree<T, arr_size, Compare>::traverse(const std::shared_ptr<TreeNode<T>> &root,
+                                 const std::function<void(std::shared_ptr<TreeNode<T>>)> &func) const {
     if (root == nullptr) return;
     func(root);
     if (root->get_type() == TYPE::INTERMEDIATE) {
@@ -156,14 +449,15 @@ void Tree<T, arr_size>::traverse(const std::shared_ptr<TreeNode<T>> &root,
  * @return true если добавление прошло успешно
  * @return false если возникли какие-то ошибки при добавлении
  */
-template<typename T, int arr_size>
-bool Tree<T, arr_size>::insert_helper(std::shared_ptr<TreeNode<T>> &node, const T &element) {
+template<typename T, int arr_size, typename Compare>
+bool Tree<T, arr_size, Compare>::insert_helper(std::shared_ptr<TreeNode<T>> &node, const T &element) {
     if (!node) {
-        node = std::make_shared<LeafNode<T, arr_size> >();
+        node = make_leaf();
         auto leaf = std::dynamic_pointer_cast<LeafNode<T, arr_size> >(node);
         leaf->add_element(element);
         return true;
     }
+    unshare(node);
 
     if (node->get_type() == TYPE::LEAF) {
         auto leaf = std::dynamic_pointer_cast<LeafNode<T, arr_size> >(node);
@@ -172,8 +466,8 @@ bool Tree<T, arr_size>::insert_helper(std::shared_ptr<TreeNode<T>> &node, const
             return true;
         }
 
-        auto new_left_node = std::make_shared<LeafNode<T, arr_size> >();
-        auto new_right_node = std::make_shared<LeafNode<T, arr_size> >();
+        auto new_left_node = make_leaf();
+        auto new_right_node = make_leaf();
 
         int mid = arr_size / 2;
 
@@ -197,31 +491,34 @@ bool Tree<T, arr_size>::insert_helper(std::shared_ptr<TreeNode<T>> &node, const
 
         if (!insert_helper(intermediate->get_right_node(), element)) {
             auto new_intermediate = std::make_shared<IntermediateNode<T, arr_size> >();
-            auto new_leaf = std::make_shared<LeafNode<T, arr_size> >();
+            auto new_leaf = make_leaf();
             new_leaf->add_element(element);
 
             new_intermediate->set_left_node(intermediate);
             new_intermediate->set_right_node(new_leaf);
 
             node = new_intermediate;
+        } else {
+            intermediate->update_size();
         }
         return true;
     }
     return false;
 }
 
-template<typename T, int arr_size>
-bool Tree<T, arr_size>::insert_helper(std::shared_ptr<TreeNode<T>> &node, size_t index, const T &element) {
+template<typename T, int arr_size, typename Compare>
+bool Tree<T, arr_size, Compare>::insert_helper(std::shared_ptr<TreeNode<T>> &node, size_t index, const T &element) {
     if (!node) {
         throw std::out_of_range("Index out of range");
     }
+    unshare(node);
 
     if (node->get_type() == TYPE::LEAF) {
         if (auto leaf = std::dynamic_pointer_cast<LeafNode<T, arr_size>>(node); !leaf->insert_by_index(index, element)) {
             const size_t mid = arr_size / 2;
 
-            auto new_left_node = std::make_shared<LeafNode<T, arr_size>>();
-            auto new_right_node = std::make_shared<LeafNode<T, arr_size>>();
+            auto new_left_node = make_leaf();
+            auto new_right_node = make_leaf();
 
             for (size_t i = 0; i < mid; ++i) {
                 new_left_node->add_element(leaf->get_element_at(i));
@@ -250,21 +547,22 @@ bool Tree<T, arr_size>::insert_helper(std::shared_ptr<TreeNode<T>> &node, size_t
 
         const size_t left_size = intermediate->get_left_node() ? intermediate->get_left_node()->get_size() : 0;
 
-        if (index < left_size) {
-            return insert_helper(intermediate->get_left_node(), index, element);
-        }
-        index -= left_size;
-        return insert_helper(intermediate->get_right_node(), index, element);
+        const bool result = index < left_size
+                                ? insert_helper(intermediate->get_left_node(), index, element)
+                                : insert_helper(intermediate->get_right_node(), index - left_size, element);
+        intermediate->update_size();
+        return result;
     }
 
     return false;
 }
 
-template<typename T, int arr_size>
-bool Tree<T, arr_size>::remove_helper(std::shared_ptr<TreeNode<T>> &node, const size_t index) {
+template<typename T, int arr_size, typename Compare>
+bool Tree<T, arr_size, Compare>::remove_helper(std::shared_ptr<TreeNode<T>> &node, const size_t index) {
     if (!node) {
         throw std::out_of_range("Index out of bounds");
     }
+    unshare(node);
 
     if (node->get_type() == TYPE::LEAF) {
         if (auto leaf = std::dynamic_pointer_cast<LeafNode<T, arr_size>>(node); index < leaf->get_size()) {
@@ -286,7 +584,7 @@ bool Tree<T, arr_size>::remove_helper(std::shared_ptr<TreeNode<T>> &node, const
             if (remove_helper(intermediate->get_left_node(), index)) {
                 if (!intermediate->get_left_node() && intermediate->get_right_node()) {
                     if (auto right_leaf = std::dynamic_pointer_cast<LeafNode<T, arr_size>>(intermediate->get_right_node())) {
-                        auto new_leaf = std::make_shared<LeafNode<T, arr_size>>();
+                        auto new_leaf = make_leaf();
                         new_leaf->add_elements(right_leaf->get_data());
                         node = new_leaf;
                     }
@@ -296,7 +594,7 @@ bool Tree<T, arr_size>::remove_helper(std::shared_ptr<TreeNode<T>> &node, const
             if (remove_helper(intermediate->get_right_node(), index - left_size)) {
                 if (intermediate->get_left_node() && !intermediate->get_right_node()) {
                     if (auto left_leaf = std::dynamic_pointer_cast<LeafNode<T, arr_size>>(intermediate->get_left_node())) {
-                        auto new_leaf = std::make_shared<LeafNode<T, arr_size>>();
+                        auto new_leaf = make_leaf();
                         new_leaf->add_elements(left_leaf->get_data());
                         node = new_leaf;
                     }
@@ -305,9 +603,10 @@ bool Tree<T, arr_size>::remove_helper(std::shared_ptr<TreeNode<T>> &node, const
         }
 
         if (!intermediate->get_left_node() && !intermediate->get_right_node()) {
-            node = std::make_shared<LeafNode<T, arr_size>>();
+            node = make_leaf();
         }
 
+        intermediate->update_size();
         return true;
     }
 
@@ -316,389 +615,2323 @@ bool Tree<T, arr_size>::remove_helper(std::shared_ptr<TreeNode<T>> &node, const
 
 
 /**
- * @brief Функция которая используется для вызова функции bool Tree<T, arr_size>::insert_helper(std::shared_ptr<TreeNode<T>> &node, const T &element)
+ * @brief Функция которая используется для вызова функции bool Tree<T, arr_size, Compare>::insert_helper(std::shared_ptr<TreeNode<T>> &node, const T &element)
  * @param element Элемент который необходимо добавить
  * @return true если добавление прошло успешно
  * @return false если возникли какие-то ошибки при добавлении
  */
-template<typename T, int arr_size>
-bool Tree<T, arr_size>::insert(const T &element) {
-    return insert_helper(root, element);
+template<typename T, int arr_size, typename Compare>
+bool Tree<T, arr_size, Compare>::insert(const T &element) {
+    return insert_helper(root, stored(element));
 }
 
-template<typename T, int arr_size>
-bool Tree<T, arr_size>::remove(const T &element) {
-    traverse(root, [&](const std::shared_ptr<TreeNode<T>> &node) {
-        if (node->get_type() == TYPE::LEAF) {
-            auto leaf = std::dynamic_pointer_cast<LeafNode<T, arr_size> >(node);
-            leaf->remove_element(element);
-        }
-    });
-    return true;
+template<typename T, int arr_size, typename Compare>
+bool Tree<T, arr_size, Compare>::remove(const T &element) {
+    return remove_equivalent(element);
 }
 
-template<typename T, int arr_size>
-T Tree<T, arr_size>::get_by_index(size_t index) {
-    return get_by_index_helper(root, index);
+/**
+ * @brief Функция удаляет все элементы, равные ключу, без создания T (только для прозрачного Compare)
+ * @param key Ключ, сравнимый с элементами
+ */
+template<typename T, int arr_size, typename Compare>
+template<typename Key, typename C, typename>
+bool Tree<T, arr_size, Compare>::remove(const Key &key) {
+    return remove_equivalent(key);
 }
 
-template<typename T, int arr_size>
-T Tree<T, arr_size>::operator[](const int index) {
-    return get_by_index(index);
+template<typename T, int arr_size, typename Compare>
+template<typename Key>
+bool Tree<T, arr_size, Compare>::remove_equivalent(const Key &key) {
+    if (auto changed = remove_equivalent_helper(root, key, true)) {
+        root = std::move(changed);
+    }
+    return true;
 }
 
-template<typename T, int arr_size>
-bool Tree<T, arr_size>::sort() {
-    if (!root) {
-        return false;
+/**
+ * @brief Функция удаляет элементы, равные ключу, из поддерева. Вершина изменяется на месте, если она и все её
+ * предки принадлежат только этому дереву, иначе изменяется её копия; вершины поддеревьев без таких элементов не
+ * копируются и не помечаются изменёнными
+ * @param node Корень поддерева (ссылка на поле родителя или корень дерева)
+ * @param key Ключ
+ * @param is_exclusive true, если все предки вершины принадлежат только этому дереву
+ * @return Вершина, которую нужно поставить на место node, или nullptr, если поддерево не изменилось
+ */
+template<typename T, int arr_size, typename Compare>
+template<typename Key>
+std::shared_ptr<TreeNode<T>> Tree<T, arr_size, Compare>::remove_equivalent_helper(
+    const std::shared_ptr<TreeNode<T>> &node, const Key &key, bool is_exclusive) {
+    if (!node) {
+        return nullptr;
     }
-
-    std::vector<T> elements = get_all_elements();
-    std::sort(elements.begin(), elements.end());
-
-    const size_t leaf_count = count_leaf_nodes(root);
-
-    if (leaf_count == 0) {
-        throw std::runtime_error("No leaf nodes found in the tree.");
+    is_exclusive = is_exclusive && node.use_count() == 1;
+    if (node->get_type() == TYPE::LEAF) {
+        bool is_found = false;
+        static_cast<const LeafNode<T, arr_size> *>(node.get())->for_each_element([&](const auto &element) {
+            is_found = is_found || equivalent(element, key);
+        });
+        if (!is_found) {
+            return nullptr;
+        }
+        auto leaf = std::static_pointer_cast<LeafNode<T, arr_size>>(is_exclusive ? node : copied(node));
+        leaf->remove_matching([&](const auto &element) { return equivalent(element, key); });
+        return leaf;
     }
 
-    size_t total_elements = elements.size();
-    size_t elements_per_leaf = total_elements / leaf_count;
-
-    auto it = elements.begin();
-
-    clear_with_struct();
-    distribute_elements(root, it, elements_per_leaf + 1, total_elements);
-
-    isTreeSorted = true;
-    return true;
+    auto *intermediate = static_cast<IntermediateNode<T, arr_size> *>(node.get());
+    auto left = remove_equivalent_helper(intermediate->get_left_node(), key, is_exclusive);
+    auto right = remove_equivalent_helper(intermediate->get_right_node(), key, is_exclusive);
+    if (!left && !right) {
+        return nullptr;
+    }
+    auto result = std::static_pointer_cast<IntermediateNode<T, arr_size>>(is_exclusive ? node : copied(node));
+    if (left) {
+        result->set_left_node(left);
+    }
+    if (right) {
+        result->set_right_node(right);
+    }
+    return result;
 }
 
 /**
- * @brief Рекурсивная функция для подсчета количества конечных узлов
- * @param node указатель на вершину дерева
- * @return 0 - если не конечная вершина
- * @return 1 - если конечная вершина
+ * @brief Функция сравнения элемента с ключом при удалении по значению (см. описание класса)
+ * @param element Элемент вершины (для std::string - std::string_view)
+ * @param key Ключ
  */
-template<typename T, int arr_size>
-size_t Tree<T, arr_size>::count_leaf_nodes(const std::shared_ptr<TreeNode<T>> &node) const {
-    if (!node) {
-        return 0;
+template<typename T, int arr_size, typename Compare>
+template<typename Element, typename Key>
+bool Tree<T, arr_size, Compare>::equivalent(const Element &element, const Key &key) const {
+    if constexpr (!std::is_same_v<Compare, std::less<>>) {
+        return !less(element, key) && !less(key, element);
+    } else if constexpr (std::is_same_v<T, char *>) {
+        return std::strcmp(element, key) == 0;
+    } else {
+        return element == key;
     }
+}
 
-    if (node->get_type() == TYPE::LEAF) {
-        return 1;
+/**
+ * @brief Порядок значений, согласованный с equivalent: удаления по значению в apply_batch упорядочиваются и ищутся
+ * так, чтобы равными считались те же элементы, что и в remove (для char* с порядком по умолчанию - по содержимому
+ * строк, а не по адресам)
+ */
+template<typename T, int arr_size, typename Compare>
+template<typename Left, typename Right>
+bool Tree<T, arr_size, Compare>::removal_less(const Left &left, const Right &right) const {
+    if constexpr (std::is_same_v<Compare, std::less<>> && std::is_same_v<T, char *>) {
+        return std::strcmp(left, right) < 0;
+    } else {
+        return less(left, right);
     }
+}
 
-    auto intermediate = std::dynamic_pointer_cast<IntermediateNode<T, arr_size> >(node);
-    return count_leaf_nodes(intermediate->get_left_node()) +
-           count_leaf_nodes(intermediate->get_right_node());
+template<typename T, int arr_size, typename Compare>
+T Tree<T, arr_size, Compare>::get_by_index(size_t index) const {
+    return get_by_index_helper(root, index);
 }
 
 /**
- * @brief Функция для получения всех элементов дерева
- * @return Массив элементов
+ * @brief Функция обходит элементы дерева в порядке их логической нумерации
+ * @param func Функция, вызываемая для каждого элемента
  */
-template<typename T, int arr_size>
-std::vector<T> Tree<T, arr_size>::get_all_elements() {
-    std::vector<T> elements;
+template<typename T, int arr_size, typename Compare>
+void Tree<T, arr_size, Compare>::for_each(const std::function<void(const T &)> &func) const {
     traverse(root, [&](const std::shared_ptr<TreeNode<T>> &node) {
         if (node->get_type() == TYPE::LEAF) {
             auto leaf = std::dynamic_pointer_cast<LeafNode<T, arr_size> >(node);
-            leaf->get_all_elements(elements);
+            for (size_t i = 0; i < leaf->get_size(); ++i) {
+                func(leaf->get_element_at(i));
+            }
         }
     });
-    return elements;
 }
 
 /**
- * Функция для вывода значений дерева при проходе 'в ширину'
+ * @brief Функция создаёт независимую (глубокую) копию дерева
+ * обычное копирование дерева разделяет вершины до первого изменения, а эта копия не разделяет с исходным деревом
+ * ни одной вершины, поэтому копии можно изменять в разных потоках без общих счётчиков ссылок; байты элементов
+ * std::string_view (arena и mapping) копия разделяет с исходным деревом
+ * @return Копия дерева, не разделяющая вершины с исходным
  */
-template<typename T, int arr_size>
-void Tree<T, arr_size>::in_order_traversal(bool is_need_to_print) {
-    traverse(root, [&](const std::shared_ptr<TreeNode<T>> &node) {
-        if (node->get_type() == TYPE::LEAF) {
-            auto leaf = std::dynamic_pointer_cast<LeafNode<T, arr_size> >(node);
-            std::vector<T> elements;
-            leaf->get_all_elements(elements);
-            if (is_need_to_print) {
-                for (auto &element: elements) {
-                    std::cout << element << " ";
-                }
-            }
-        }
-    });
+template<typename T, int arr_size, typename Compare>
+Tree<T, arr_size, Compare> Tree<T, arr_size, Compare>::clone() const {
+    Tree copy(compare);
+    copy.root = clone_helper(root);
+    copy.isTreeSorted = isTreeSorted;
+    copy.arena = arena;
+    copy.mapping = mapping;
+    return copy;
 }
 
 /**
- * @brief Функция для сохранения дерева в бинарный файл
- * @param ofs Поток ввода
+ * @brief Рекурсивная функция для копирования поддерева
+ * @param node Указатель на вершину копируемого поддерева
+ * @return Указатель на вершину копии
  */
-template<typename T, int arr_size>
-void Tree<T, arr_size>::save_to_binary_file(std::ofstream &ofs) {
-    if (!root) {
-        uint8_t tree_status = 0; // дерево пустое
-        ofs.write(reinterpret_cast<const char *>(&tree_status), sizeof(tree_status));
-        return;
+template<typename T, int arr_size, typename Compare>
+std::shared_ptr<TreeNode<T>> Tree<T, arr_size, Compare>::clone_helper(const std::shared_ptr<TreeNode<T>> &node) const {
+    if (!node) {
+        return nullptr;
     }
 
-    uint8_t tree_status = 1; // дерево существует
-    ofs.write(reinterpret_cast<const char *>(&tree_status), sizeof(tree_status));
-
-    auto save_node = [&ofs](const std::shared_ptr<TreeNode<T>> &node) {
-        if (node->get_type() == TYPE::LEAF) {
-            auto type = static_cast<uint8_t>(TYPE::LEAF);
-            ofs.write(reinterpret_cast<const char *>(&type), sizeof(type));
-            auto leaf = std::dynamic_pointer_cast<LeafNode<T, arr_size> >(node);
-            const size_t size = leaf->get_size();
-            ofs.write(reinterpret_cast<const char *>(&size), sizeof(size));
-            std::vector<T> elements;
-            leaf->get_all_elements(elements);
-            for (const auto &element : elements) {
-                ofs.write(reinterpret_cast<const char *>(&element), sizeof(T));
-            }
-        } else if (node->get_type() == TYPE::INTERMEDIATE) {
-            const auto type = static_cast<uint8_t>(TYPE::INTERMEDIATE);
-            ofs.write(reinterpret_cast<const char *>(&type), sizeof(type));
+    if (node->get_type() == TYPE::LEAF) {
+        auto leaf = std::dynamic_pointer_cast<LeafNode<T, arr_size>>(node);
+        auto copy = make_leaf();
+        for (size_t i = 0; i < leaf->get_size(); ++i) {
+            copy->add_element(leaf->get_element_at(i));
         }
-    };
+        return copy;
+    }
 
-    traverse(root, save_node);
+    auto intermediate = std::dynamic_pointer_cast<IntermediateNode<T, arr_size>>(node);
+    auto copy = std::make_shared<IntermediateNode<T, arr_size>>();
+    copy->set_left_node(clone_helper(intermediate->get_left_node()));
+    copy->set_right_node(clone_helper(intermediate->get_right_node()));
+    return copy;
 }
 
 /**
- * @brief Функция для загрузки дерева из бинарного файла
- * @param ifs Поток выходных данных
+ * @brief Функция возвращает вершину, которую можно изменять: саму вершину, если других ссылок на неё нет, иначе
+ * её копию. Копия промежуточной вершины ссылается на те же поддеревья, поэтому они становятся разделяемыми и
+ * копируются при спуске к ним
+ * @param node Указатель на вершину
+ * @return Указатель на вершину, принадлежащую только этому дереву
  */
-template<typename T, int arr_size>
-void Tree<T, arr_size>::load_from_binary_file(std::ifstream &ifs) {
-    if (!ifs.is_open()) {
-        throw std::runtime_error("Ошибка: файл не удалось открыть для чтения.");
+template<typename T, int arr_size, typename Compare>
+std::shared_ptr<TreeNode<T>> Tree<T, arr_size, Compare>::unshared(const std::shared_ptr<TreeNode<T>> &node) const {
+    if (!node || node.use_count() == 1) {
+        return node;
     }
+    return copied(node);
+}
 
-    uint8_t tree_status;
-    ifs.read(reinterpret_cast<char *>(&tree_status), sizeof(tree_status));
-    if (!ifs || tree_status == 0) {
-        root.reset();
-        return; // пустое дерево
+/**
+ * @brief Функция копирует вершину; копия промежуточной вершины ссылается на те же поддеревья
+ * @param node Указатель на вершину
+ * @return Указатель на копию
+ */
+template<typename T, int arr_size, typename Compare>
+std::shared_ptr<TreeNode<T>> Tree<T, arr_size, Compare>::copied(const std::shared_ptr<TreeNode<T>> &node) const {
+    if (node->get_type() == TYPE::LEAF) {
+        auto leaf = std::static_pointer_cast<LeafNode<T, arr_size>>(node);
+        auto copy = make_leaf();
+        copy->copy_from(*leaf);
+        return copy;
     }
 
-    std::function<std::shared_ptr<TreeNode<T>>()> load_node = [&]() {
-        uint8_t type;
-        ifs.read(reinterpret_cast<char *>(&type), sizeof(type));
-
-        if (static_cast<TYPE>(type) == TYPE::LEAF) {
-            size_t size;
-            ifs.read(reinterpret_cast<char *>(&size), sizeof(size));
-
-            auto leaf = std::make_shared<LeafNode<T, arr_size>>();
-            for (size_t i = 0; i < size; ++i) {
-                T element;
-                ifs.read(reinterpret_cast<char *>(&element), sizeof(T));
-                leaf->add_element(element);
-            }
-            return std::static_pointer_cast<TreeNode<T>>(leaf);
-        }
-
-        if (static_cast<TYPE>(type) == TYPE::INTERMEDIATE) {
-            auto intermediate = std::make_shared<IntermediateNode<T, arr_size>>();
-            intermediate->set_left_node(load_node());
-            intermediate->set_right_node(load_node());
-            return std::static_pointer_cast<TreeNode<T>>(intermediate);
-        }
-
-        return std::shared_ptr<TreeNode<T>>(nullptr);
-    };
-
-    root = load_node();
+    auto intermediate = std::static_pointer_cast<IntermediateNode<T, arr_size>>(node);
+    auto copy = std::make_shared<IntermediateNode<T, arr_size>>();
+    copy->set_left_node(intermediate->get_left_node());
+    copy->set_right_node(intermediate->get_right_node());
+    return copy;
+}
+
+/**
+ * @brief Рекурсивная функция, которая делает изменяемыми все вершины поддерева
+ * используется перед операциями, изменяющими конечные вершины в обход спуска от корня
+ * @param node Указатель на вершину поддерева
+ */
+template<typename T, int arr_size, typename Compare>
+void Tree<T, arr_size, Compare>::unshare_all(std::shared_ptr<TreeNode<T>> &node) const {
+    if (!node) {
+        return;
+    }
+    unshare(node);
+    if (node->get_type() == TYPE::INTERMEDIATE) {
+        auto intermediate = std::static_pointer_cast<IntermediateNode<T, arr_size>>(node);
+        unshare_all(intermediate->get_left_node());
+        unshare_all(intermediate->get_right_node());
+    }
+}
+
+template<typename T, int arr_size, typename Compare>
+T Tree<T, arr_size, Compare>::operator[](const int index) {
+    return get_by_index(index);
+}
+
+template<typename T, int arr_size, typename Compare>
+bool Tree<T, arr_size, Compare>::sort() {
+    if (!root) {
+        return false;
+    }
+
+    if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>) {
+        sort_strings();
+    } else if constexpr (std::is_same_v<T, InternedString>) {
+        sort_interned();
+    } else {
+        std::vector<T> elements = get_all_elements();
+        std::sort(elements.begin(), elements.end(), compare);
+        rewrite_sorted(elements.begin(), elements.size());
+    }
+
+    isTreeSorted = true;
+    return true;
+}
+
+/**
+ * @brief Функция раскладывает упорядоченные элементы по конечным вершинам дерева, структура дерева сохраняется
+ * @param elements Итератор на первый элемент
+ * @param total_elements Количество элементов, равно размеру дерева
+ */
+template<typename T, int arr_size, typename Compare>
+template<typename It>
+void Tree<T, arr_size, Compare>::rewrite_sorted(It elements, size_t total_elements) {
+    const size_t leaf_count = count_leaf_nodes(root);
+
+    if (leaf_count == 0) {
+        throw std::runtime_error("No leaf nodes found in the tree.");
+    }
+
+    // вершин хватает на все элементы, поэтому в каждую попадает не больше arr_size элементов, даже если после
+    // balance() все вершины заполнены
+    const size_t elements_per_leaf = (total_elements + leaf_count - 1) / leaf_count;
+
+    unshare_all(root);
+    clear_with_struct();
+    size_t remaining_elements = total_elements;
+    distribute_elements(root, elements, elements_per_leaf, remaining_elements);
+    if (remaining_elements != 0) {
+        throw std::runtime_error("Ошибка: элементы не поместились в конечные вершины.");
+    }
+    recount(root);
+}
+
+/**
+ * @brief Функция сортирует дерево строк (см. StringSort.h, для порядка не по умолчанию - std::sort с Compare)
+ * сортируются представления строк, а не копии std::string: для std::string_view - сами элементы (байты лежат в
+ * области памяти дерева или в отображённом файле), для std::string байты всех вершин один раз копируются в общий
+ * буфер, потому что вершины очищаются перед раскладкой. Каждая вершина затем заполняется одним вызовом assign
+ */
+template<typename T, int arr_size, typename Compare>
+void Tree<T, arr_size, Compare>::sort_strings() {
+    std::vector<std::string_view> elements;
+    elements.reserve(size());
+    std::vector<char> text;
+    std::vector<size_t> ends;
+
+    traverse(root, [&](const std::shared_ptr<TreeNode<T>> &node) {
+        if (node->get_type() != TYPE::LEAF) {
+            return;
+        }
+        const auto leaf = std::static_pointer_cast<LeafNode<T, arr_size>>(node);
+        leaf->for_each_element([&](const std::string_view element) {
+            if constexpr (std::is_same_v<T, std::string>) {
+                text.insert(text.end(), element.begin(), element.end());
+                ends.push_back(text.size());
+            } else {
+                elements.push_back(element);
+            }
+        });
+    });
+
+    if constexpr (std::is_same_v<T, std::string>) {
+        size_t begin = 0;
+        for (const size_t end: ends) {
+            elements.emplace_back(text.data() + begin, end - begin);
+            begin = end;
+        }
+    }
+
+    if constexpr (std::is_same_v<Compare, std::less<>>) {
+        multikey_sort(elements.data(), elements.size());
+    } else if constexpr (std::is_same_v<T, std::string> &&
+                         !std::is_invocable_r_v<bool, const Compare &, std::string_view, std::string_view>) {
+        // порядок только для std::string: строки копируются один раз, а не при каждом сравнении
+        std::vector<std::string> strings(elements.begin(), elements.end());
+        std::sort(strings.begin(), strings.end(), compare);
+        rewrite_sorted(strings.begin(), strings.size());
+        return;
+    } else {
+        std::sort(elements.begin(), elements.end(),
+                  [this](const auto &left, const auto &right) { return less(left, right); });
+    }
+    rewrite_sorted(elements.begin(), elements.size());
+}
+
+/**
+ * @brief Функция сортирует дерево интернированных строк: элементы сначала группируются по номерам (сравнение
+ * чисел), затем упорядочиваются только различные строки, и каждая группа выписывается целиком. Строки
+ * сравниваются по одному разу на различную строку, а не на каждое сравнение элементов
+ */
+template<typename T, int arr_size, typename Compare>
+void Tree<T, arr_size, Compare>::sort_interned() {
+    std::vector<T> elements = get_all_elements();
+    std::sort(elements.begin(), elements.end(), [](const T &left, const T &right) {
+        return left.get_id() < right.get_id();
+    });
+
+    std::vector<std::pair<T, size_t>> groups;
+    for (const auto &element: elements) {
+        if (groups.empty() || groups.back().first != element) {
+            groups.emplace_back(element, 0);
+        }
+        ++groups.back().second;
+    }
+    std::sort(groups.begin(), groups.end(), [this](const auto &left, const auto &right) {
+        return compare(left.first, right.first);
+    });
+
+    auto it = elements.begin();
+    for (const auto &[element, count]: groups) {
+        it = std::fill_n(it, count, element);
+    }
+    rewrite_sorted(elements.begin(), elements.size());
+}
+
+/**
+ * @brief Функция выбирает поддерево упорядоченного дерева при спуске по значению: левое, если key не больше
+ * первого элемента правого поддерева. Первый элемент ищется спуском по левым вершинам и читается без копирования
+ * (у сжатой вершины строк это полная запись), а get_max_value обходил бы всё левое поддерево. Если element больше
+ * всех элементов левого поддерева, спуск влево заканчивается в конце левого поддерева, то есть на той же позиции
+ * @param node Промежуточная вершина
+ * @param key Элемент или ключ, сравнимый с элементами
+ * @return true - если спуск идёт в левое поддерево
+ */
+template<typename T, int arr_size, typename Compare>
+template<typename Key>
+bool Tree<T, arr_size, Compare>::goes_left(const std::shared_ptr<IntermediateNode<T, arr_size>> &node,
+                                           const Key &key) const {
+    const auto &left = node->get_left_node();
+    if (!left || left->get_size() == 0) {
+        return false;
+    }
+    std::shared_ptr<TreeNode<T>> first = node->get_right_node();
+    if (!first || first->get_size() == 0) {
+        return true;
+    }
+    while (first->get_type() == TYPE::INTERMEDIATE) {
+        auto intermediate = std::static_pointer_cast<IntermediateNode<T, arr_size>>(first);
+        const auto &first_left = intermediate->get_left_node();
+        first = first_left && first_left->get_size() > 0 ? first_left : intermediate->get_right_node();
+    }
+    return !less(std::static_pointer_cast<LeafNode<T, arr_size>>(first)->element_view(0), key);
+}
+
+/**
+ * @brief Функция находит в упорядоченном дереве номер первого элемента, не меньшего element: спуск по первым
+ * элементам правых поддеревьев (см. goes_left) и двоичный поиск в конечной вершине
+ * @param element Элемент
+ * @return Номер элемента или size(), если все элементы меньше
+ */
+template<typename T, int arr_size, typename Compare>
+size_t Tree<T, arr_size, Compare>::lower_bound(const T &element) const {
+    return lower_bound_helper(element);
+}
+
+/**
+ * @brief Функция находит номер первого элемента, не меньшего ключа, без создания T (только для прозрачного Compare)
+ * @param key Ключ, сравнимый с элементами
+ */
+template<typename T, int arr_size, typename Compare>
+template<typename Key, typename C, typename>
+size_t Tree<T, arr_size, Compare>::lower_bound(const Key &key) const {
+    return lower_bound_helper(key);
+}
+
+template<typename T, int arr_size, typename Compare>
+template<typename Key>
+size_t Tree<T, arr_size, Compare>::lower_bound_helper(const Key &key) const {
+    if (!isTreeSorted) {
+        throw std::runtime_error("Ошибка: поиск по значению возможен только в упорядоченном дереве.");
+    }
+    if (!root) {
+        return 0;
+    }
+
+    size_t offset = 0;
+    auto node = root;
+    while (node->get_type() == TYPE::INTERMEDIATE) {
+        auto intermediate = std::static_pointer_cast<IntermediateNode<T, arr_size>>(node);
+        if (goes_left(intermediate, key)) {
+            node = intermediate->get_left_node();
+        } else {
+            offset += intermediate->get_left_node() ? intermediate->get_left_node()->get_size() : 0;
+            node = intermediate->get_right_node();
+        }
+    }
+    return offset + std::static_pointer_cast<LeafNode<T, arr_size>>(node)->lower_bound(
+               key, [this](const auto &left, const auto &right) { return less(left, right); });
+}
+
+/**
+ * @brief Функция сжимает конечные вершины дерева строк общими префиксами соседних строк (см.
+ * LeafNode<std::string>), сильнее всего - после sort(). Чтение, поиск и сохранение раскодируют строки сами,
+ * изменённая вершина возвращается к обычному виду
+ * @return Количество освобождённых байт
+ */
+template<typename T, int arr_size, typename Compare>
+size_t Tree<T, arr_size, Compare>::compress_prefixes() {
+    static_assert(std::is_same_v<T, std::string>, "prefix compression requires std::string elements");
+    unshare_all(root);
+    size_t freed = 0;
+    traverse(root, [&freed](const std::shared_ptr<TreeNode<T>> &node) {
+        if (node->get_type() == TYPE::LEAF) {
+            freed += std::static_pointer_cast<LeafNode<T, arr_size>>(node)->front_code();
+        }
+    });
+    return freed;
+}
+
+/**
+ * @brief Рекурсивная функция для подсчета количества конечных узлов
+ * @param node указатель на вершину дерева
+ * @return 0 - если не конечная вершина
+ * @return 1 - если конечная вершина
+ */
+template<typename T, int arr_size, typename Compare>
+size_t Tree<T, arr_size, Compare>::count_leaf_nodes(const std::shared_ptr<TreeNode<T>> &node) const {
+    if (!node) {
+        return 0;
+    }
+
+    if (node->get_type() == TYPE::LEAF) {
+        return 1;
+    }
+
+    auto intermediate = std::dynamic_pointer_cast<IntermediateNode<T, arr_size> >(node);
+    return count_leaf_nodes(intermediate->get_left_node()) +
+           count_leaf_nodes(intermediate->get_right_node());
+}
+
+/**
+ * @brief Функция для получения всех элементов дерева
+ * @return Массив элементов
+ */
+template<typename T, int arr_size, typename Compare>
+std::vector<T> Tree<T, arr_size, Compare>::get_all_elements() {
+    std::vector<T> elements;
+    traverse(root, [&](const std::shared_ptr<TreeNode<T>> &node) {
+        if (node->get_type() == TYPE::LEAF) {
+            auto leaf = std::dynamic_pointer_cast<LeafNode<T, arr_size> >(node);
+            leaf->get_all_elements(elements);
+        }
+    });
+    return elements;
+}
+
+/**
+ * Функция для вывода значений дерева при проходе 'в ширину'
+ */
+template<typename T, int arr_size, typename Compare>
+void Tree<T, arr_size, Compare>::in_order_traversal(bool is_need_to_print) {
+    traverse(root, [&](const std::shared_ptr<TreeNode<T>> &node) {
+        if (node->get_type() == TYPE::LEAF) {
+            auto leaf = std::dynamic_pointer_cast<LeafNode<T, arr_size> >(node);
+            std::vector<T> elements;
+            leaf->get_all_elements(elements);
+            if (is_need_to_print) {
+                for (auto &element: elements) {
+                    std::cout << element << " ";
+                }
+            }
+        }
+    });
+}
+
+/**
+ * @brief Функция для сохранения дерева в бинарный файл формата версии 2 (см. BinaryFormat.h)
+ * элементы каждой конечной вершины пишутся одним блоком через буфер BinaryWriter, в конце файла записывается
+ * индекс конечных вершин для открытия файла через MappedTree
+ * @param ofs Поток ввода
+ * @param encoding Способ записи элементов, DELTA_VARINT допустим только для целочисленных типов
+ */
+template<typename T, int arr_size, typename Compare>
+void Tree<T, arr_size, Compare>::save_to_binary_file(std::ofstream &ofs, const ENCODING encoding) {
+    const bool is_compressed = encoding == ENCODING::DELTA_VARINT;
+    if (is_compressed && !is_delta_encodable_v<T>) {
+        throw std::runtime_error("Ошибка: сжатие поддерживается только для целочисленных типов.");
+    }
+
+    std::vector<LeafNode<T, arr_size> *> leaves;
+    traverse(root, [&](const std::shared_ptr<TreeNode<T>> &node) {
+        if (node->get_type() == TYPE::LEAF && node->get_size() > 0) {
+            leaves.push_back(static_cast<LeafNode<T, arr_size> *>(node.get()));
+        }
+    });
+
+    BinaryHeader header{};
+    std::memcpy(header.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC));
+    header.version = BINARY_VERSION;
+    header.endian = BINARY_ENDIAN_MARKER;
+    header.flags = BINARY_FLAG_LEAF_INDEX | (is_compressed ? BINARY_FLAG_DELTA_VARINT : 0);
+    header.element_size = Serializer<T>::element_size;
+    header.element_count = size();
+    header.arr_size = arr_size;
+    header.leaf_count = leaves.size();
+
+    std::vector<uint64_t> index;
+    index.reserve(2 * leaves.size());
+    uint64_t elements_before = 0;
+    std::vector<uint8_t> encoded;
+
+    BinaryWriter writer(ofs);
+    writer.write_value(header);
+    for (const auto leaf: leaves) {
+        const uint64_t leaf_size = leaf->get_size();
+        index.push_back(writer.tell());
+        index.push_back(elements_before);
+        elements_before += leaf_size;
+
+        writer.write_value(leaf_size);
+        if constexpr (is_delta_encodable_v<T>) {
+            if (is_compressed) {
+                encoded.clear();
+                delta_encode(leaf->raw_data(), leaf_size, encoded);
+                writer.write_value(static_cast<uint64_t>(encoded.size()));
+                writer.write(encoded.data(), encoded.size());
+                writer.pad();
+                continue;
+            }
+        }
+        leaf->write_block(writer);
+        writer.pad();
+    }
+
+    BinaryFooter footer{};
+    footer.index_offset = writer.tell();
+    std::memcpy(footer.magic, BINARY_FOOTER_MAGIC, sizeof(BINARY_FOOTER_MAGIC));
+    writer.write(index.data(), index.size() * sizeof(uint64_t));
+    writer.write_value(footer);
+    writer.flush();
+}
+
+/**
+ * @brief Функция сохраняет дерево в бинарный файл в фоновом потоке
+ * поток получает копию дерева, которая разделяет с ним вершины (см. копирование при записи в описании класса),
+ * поэтому снимок берётся без копирования элементов, а дерево можно изменять во время сохранения. Файл пишется
+ * во временный path.tmp и переименовывается в path после записи, поэтому по пути path всегда лежит целый снимок.
+ * Дерево с подкачкой (см. enable_paging) сохраняется в вызывающем потоке
+ * @param path Путь к файлу
+ * @param encoding Способ записи элементов
+ * @return Результат сохранения, get() выбрасывает исключение, если запись не удалась
+ */
+template<typename T, int arr_size, typename Compare>
+std::future<void> Tree<T, arr_size, Compare>::save_async(const std::string &path, const ENCODING encoding) const {
+    auto save = [frozen = *this, path, encoding]() mutable {
+        const std::string temporary = path + ".tmp";
+        {
+            std::ofstream ofs(temporary, std::ios::binary | std::ios::trunc);
+            if (!ofs) {
+                throw std::runtime_error("Ошибка: файл не удалось открыть для записи: " + temporary);
+            }
+            frozen.save_to_binary_file(ofs, encoding);
+        }
+        if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+            throw std::runtime_error("Ошибка: не удалось переименовать снимок в " + path);
+        }
+    };
+
+    if (pager) {
+        // вершины дерева с подкачкой читаются только из одного потока, поэтому снимок пишется сразу
+        std::promise<void> saved;
+        try {
+            save();
+            saved.set_value();
+        } catch (...) {
+            saved.set_exception(std::current_exception());
+        }
+        return saved.get_future();
+    }
+    return std::async(std::launch::async, std::move(save));
+}
+
+/**
+ * @brief Функция для загрузки дерева из бинарного файла
+ * файлы версии 2 определяются по сигнатуре, остальные читаются в исходном формате
+ * @param ifs Поток выходных данных
+ */
+template<typename T, int arr_size, typename Compare>
+void Tree<T, arr_size, Compare>::load_from_binary_file(std::ifstream &ifs) {
+    if (!ifs.is_open()) {
+        throw std::runtime_error("Ошибка: файл не удалось открыть для чтения.");
+    }
+
+    if (ifs.peek() == BINARY_MAGIC[0]) {
+        load_from_binary_file_v2(ifs);
+    } else {
+        load_from_binary_file_v1(ifs);
+    }
+}
+
+/**
+ * @brief Функция для загрузки дерева из бинарного файла формата версии 2
+ * если размер массива конечной вершины совпадает, блоки элементов копируются в конечные вершины целиком, иначе
+ * элементы перераспределяются по вершинам этого дерева. Над конечными вершинами строится сбалансированное дерево
+ * @param ifs Поток выходных данных
+ */
+template<typename T, int arr_size, typename Compare>
+void Tree<T, arr_size, Compare>::load_from_binary_file_v2(std::ifstream &ifs) {
+    BinaryReader reader(ifs);
+    auto header = reader.read_value<BinaryHeader>();
+    const bool is_swapped = normalize_header(header);
+
+    if (header.version != BINARY_VERSION) {
+        throw std::runtime_error("Ошибка: неподдерживаемая версия бинарного файла.");
+    }
+    if (header.element_size != Serializer<T>::element_size) {
+        throw std::runtime_error("Ошибка: размер элемента в файле не совпадает с типом дерева.");
+    }
+
+    const bool is_compressed = header.flags & BINARY_FLAG_DELTA_VARINT;
+    if (is_compressed && !is_delta_encodable_v<T>) {
+        throw std::runtime_error("Ошибка: сжатые блоки поддерживаются только для целочисленных типов.");
+    }
+
+    std::vector<T> block;
+    std::vector<uint8_t> encoded;
+    std::vector<T> elements;
+    std::vector<std::shared_ptr<TreeNode<T>>> leaves;
+    const bool is_same_layout = header.arr_size == static_cast<uint64_t>(arr_size);
+
+    for (uint64_t i = 0; i < header.leaf_count; ++i) {
+        auto leaf_size = reader.read_value<uint64_t>();
+        if (is_swapped) {
+            swap_bytes(&leaf_size, sizeof(leaf_size));
+        }
+        if (leaf_size > header.element_count) {
+            throw std::runtime_error("Ошибка: повреждён бинарный файл.");
+        }
+
+        if constexpr (std::is_same_v<T, std::string>) {
+            // строки читаются сразу в упакованную вершину, без std::string на каждый элемент
+            if (is_same_layout) {
+                auto leaf = make_leaf();
+                if (!leaf->read_block(reader, leaf_size, is_swapped)) {
+                    throw std::runtime_error("Ошибка: повреждён бинарный файл.");
+                }
+                reader.skip_padding();
+                leaves.push_back(leaf);
+                continue;
+            }
+        }
+
+        block.resize(leaf_size);
+        if constexpr (is_delta_encodable_v<T>) {
+            if (is_compressed) {
+                auto encoded_size = reader.read_value<uint64_t>();
+                if (is_swapped) {
+                    swap_bytes(&encoded_size, sizeof(encoded_size));
+                }
+                if (encoded_size > leaf_size * 10) {
+                    throw std::runtime_error("Ошибка: повреждён бинарный файл.");
+                }
+                encoded.resize(encoded_size);
+                reader.read(encoded.data(), encoded.size());
+                delta_decode(encoded.data(), encoded.size(), block.data(), block.size());
+            }
+        }
+        if (!is_compressed) {
+            Serializer<T>::read_block(reader, block.data(), leaf_size, is_swapped, get_arena());
+        }
+        reader.skip_padding();
+
+        if (is_same_layout) {
+            auto leaf = make_leaf();
+            if (!leaf->assign(std::make_move_iterator(block.begin()), block.size())) {
+                throw std::runtime_error("Ошибка: повреждён бинарный файл.");
+            }
+            leaves.push_back(leaf);
+        } else {
+            elements.insert(elements.end(), std::make_move_iterator(block.begin()),
+                            std::make_move_iterator(block.end()));
+        }
+    }
+
+    if (is_same_layout) {
+        build_from_leaves(leaves);
+    } else {
+        build_from_elements(elements);
+    }
+    isTreeSorted = false;
+}
+
+/**
+ * @brief Функция для загрузки дерева из бинарного файла исходного формата (по вершинам в прямом обходе)
+ * @param ifs Поток выходных данных
+ */
+template<typename T, int arr_size, typename Compare>
+void Tree<T, arr_size, Compare>::load_from_binary_file_v1(std::ifstream &ifs) {
+    if constexpr (!std::is_trivially_copyable_v<T>) {
+        throw std::runtime_error("Ошибка: исходный формат поддерживает только тривиально копируемые типы.");
+    }
+
+    uint8_t tree_status;
+    ifs.read(reinterpret_cast<char *>(&tree_status), sizeof(tree_status));
+    if (!ifs || tree_status == 0) {
+        root.reset();
+        return; // пустое дерево
+    }
+
+    std::function<std::shared_ptr<TreeNode<T>>()> load_node = [&]() {
+        uint8_t type;
+        ifs.read(reinterpret_cast<char *>(&type), sizeof(type));
+
+        if (static_cast<TYPE>(type) == TYPE::LEAF) {
+            size_t size;
+            ifs.read(reinterpret_cast<char *>(&size), sizeof(size));
+
+            auto leaf = make_leaf();
+            for (size_t i = 0; i < size; ++i) {
+                T element;
+                ifs.read(reinterpret_cast<char *>(&element), sizeof(T));
+                leaf->add_element(element);
+            }
+            return std::static_pointer_cast<TreeNode<T>>(leaf);
+        }
+
+        if (static_cast<TYPE>(type) == TYPE::INTERMEDIATE) {
+            auto intermediate = std::make_shared<IntermediateNode<T, arr_size>>();
+            intermediate->set_left_node(load_node());
+            intermediate->set_right_node(load_node());
+            return std::static_pointer_cast<TreeNode<T>>(intermediate);
+        }
+
+        return std::shared_ptr<TreeNode<T>>(nullptr);
+    };
+
+    root = load_node();
+}
+
+/**
+ * @brief Функция форматирует вершины в текстовый формат дерева
+ * @param nodes Вершины в порядке прямого обхода
+ * @param begin Начало диапазона
+ * @param end Конец диапазона (не включительно)
+ * @param out Буфер, в конец которого дописывается текст
+ */
+template<typename T, int arr_size, typename Compare>
+void Tree<T, arr_size, Compare>::format_text(const std::vector<TreeNode<T> *> &nodes, const size_t begin, const size_t end,
+                                    std::string &out) const {
+    for (size_t i = begin; i < end; ++i) {
+        if (nodes[i]->get_type() == TYPE::LEAF) {
+            const auto *leaf = static_cast<const LeafNode<T, arr_size> *>(nodes[i]);
+            out += "LeafNode: ";
+            leaf->for_each_element([&out](const auto &element) {
+                append_text_element(out, element);
+                out += ' ';
+            });
+            out += '\n';
+        } else {
+            out += "IntermediateNode\n";
+        }
+    }
+}
+
+/**
+ * @brief Функция для сохранения дерева в текстовый файл (формат см. TextIO.h)
+ * вершины форматируются в большой буфер, который пишется в поток блоками. При threads > 1 вершины в порядке
+ * обхода делятся на последовательные части, которые форматируются параллельно и пишутся в исходном порядке;
+ * запись готовой части идёт одновременно с форматированием следующих
+ * @param os Поток вывода данных
+ * @param threads Количество потоков форматирования
+ */
+template<typename T, int arr_size, typename Compare>
+void Tree<T, arr_size, Compare>::save_to_text(std::ostream &os, size_t threads) const {
+    if (pager) {
+        // вершины дерева с подкачкой читаются только из одного потока
+        threads = 1;
+    }
+    if (!root) {
+        os << "Empty tree\n";
+        return;
+    }
+
+    std::vector<TreeNode<T> *> nodes;
+    traverse(root, [&](const std::shared_ptr<TreeNode<T>> &node) { nodes.push_back(node.get()); });
+
+    // примерно TEXT_BLOCK_SIZE байт текста на часть при коротких числах
+    const size_t part_nodes = std::max<size_t>(1, TEXT_BLOCK_SIZE / (8 * arr_size));
+    std::string buffer;
+
+    if (threads <= 1) {
+        buffer.reserve(TEXT_BLOCK_SIZE + TEXT_BLOCK_SIZE / 4);
+        for (size_t begin = 0; begin < nodes.size(); begin += part_nodes) {
+            format_text(nodes, begin, std::min(nodes.size(), begin + part_nodes), buffer);
+            if (buffer.size() >= TEXT_BLOCK_SIZE) {
+                os.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+                buffer.clear();
+            }
+        }
+        os.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        return;
+    }
+
+    for (size_t round = 0; round < nodes.size(); round += part_nodes * threads) {
+        std::vector<std::future<std::string>> parts;
+        for (size_t begin = round; begin < std::min(nodes.size(), round + part_nodes * threads); begin += part_nodes) {
+            const size_t end = std::min(nodes.size(), begin + part_nodes);
+            parts.push_back(std::async(std::launch::async, [this, &nodes, begin, end] {
+                std::string part;
+                format_text(nodes, begin, end, part);
+                return part;
+            }));
+        }
+        for (auto &part: parts) {
+            buffer = part.get();
+            os.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        }
+    }
+}
+
+/**
+ * @brief Функция для загрузки дерева из текстового файла (см. TextIO.h)
+ * поток читается крупными блоками, элементы строк LeafNode разбираются без промежуточных потоков и сразу
+ * складываются в заполненные конечные вершины, над которыми в конце строится сбалансированное дерево. Как и при
+ * чтении через operator>>, разбор строки прекращается на первом слове, которое не является значением типа T
+ * @param is Поток входных данных
+ */
+template<typename T, int arr_size, typename Compare>
+void Tree<T, arr_size, Compare>::load_from_text(std::istream &is) {
+    clear();
+    // байты строк char* нужны только до копирования в вершину, а std::string_view ссылаются на них постоянно
+    StringArena scratch;
+    StringArena *strings = std::is_same_v<T, std::string_view> ? &get_arena() : &scratch;
+
+    std::vector<std::shared_ptr<TreeNode<T>>> leaves;
+    std::vector<TextElement> block;
+    block.reserve(arr_size);
+
+    TextLineReader reader(is);
+    std::string_view line;
+    while (reader.next_line(line)) {
+        parse_text(line, block, leaves, strings);
+        if constexpr (std::is_same_v<T, std::string>) {
+            if (block.empty()) {
+                // байты слов уже скопированы в вершины
+                scratch.clear();
+            }
+        }
+    }
+    flush_text_block(block, leaves);
+    build_from_leaves(leaves);
+}
+
+/**
+ * @brief Функция загружает дерево из текстового файла, разбирая его в нескольких потоках (см. parse_text_parts)
+ * элементы std::string_view ссылаются прямо на отображённый файл без копирования, отображение живёт, пока
+ * дерево (или его копия) не очищено, поэтому загрузка стоит только разбора. Файл не должен изменяться, пока
+ * дерево ссылается на него
+ * @param path Путь к файлу
+ * @param threads Количество потоков разбора
+ */
+template<typename T, int arr_size, typename Compare>
+void Tree<T, arr_size, Compare>::load_from_text_file(const std::string &path, size_t threads) {
+    auto file = std::make_shared<const MappedFile>(path);
+    file->advise_sequential();
+    if (threads == 0 || pager) {
+        threads = 1;
+    }
+
+    auto leaves = parse_text_parts(std::string_view(file->data(), file->size()), threads,
+                                   [this](const std::string_view line, std::vector<TextElement> &block,
+                                          std::vector<std::shared_ptr<TreeNode<T>>> &part_leaves,
+                                          StringArena *strings) {
+                                       parse_text(line, block, part_leaves, strings);
+                                   });
+    clear();
+    if constexpr (std::is_same_v<T, std::string_view>) {
+        mapping = std::move(file);
+    }
+    build_from_leaves(leaves);
+}
+
+/**
+ * @brief Функция загружает в дерево слова или строки обычного текстового файла (например, корпуса текстов)
+ * разбор идёт в нескольких потоках так же, как в load_from_text_file, и так же без копирования для
+ * std::string_view; слова, которые не являются значением типа T, пропускаются
+ * @param path Путь к файлу
+ * @param split Элемент дерева - слово или строка (без символов перевода строки)
+ * @param threads Количество потоков разбора
+ */
+template<typename T, int arr_size, typename Compare>
+void Tree<T, arr_size, Compare>::load_tokens_from_file(const std::string &path, const TEXT_SPLIT split, size_t threads) {
+    auto file = std::make_shared<const MappedFile>(path);
+    file->advise_sequential();
+    if (threads == 0 || pager) {
+        threads = 1;
+    }
+
+    auto leaves = parse_text_parts(std::string_view(file->data(), file->size()), threads,
+                                   [this, split](std::string_view line, std::vector<TextElement> &block,
+                                                 std::vector<std::shared_ptr<TreeNode<T>>> &part_leaves,
+                                                 StringArena *strings) {
+                                       TextElement element{};
+                                       if (split == TEXT_SPLIT::LINES) {
+                                           if (!line.empty() && line.back() == '\r') {
+                                               line.remove_suffix(1);
+                                           }
+                                           if (parse_token(line, element, strings)) {
+                                               add_text_element(std::move(element), block, part_leaves);
+                                           }
+                                           return;
+                                       }
+                                       for_each_token(line, [&](const std::string_view token) {
+                                           if (parse_token(token, element, strings)) {
+                                               add_text_element(std::move(element), block, part_leaves);
+                                           }
+                                           return true;
+                                       });
+                                   });
+    clear();
+    if constexpr (std::is_same_v<T, std::string_view>) {
+        mapping = std::move(file);
+    }
+    build_from_leaves(leaves);
+}
+
+/**
+ * @brief Функция разбирает текст в нескольких потоках
+ * текст делится по границам строк на части (не меньше TEXT_BLOCK_SIZE байт), которые разбираются параллельно в
+ * собственные последовательности конечных вершин, и вершины всех частей возвращаются в порядке текста.
+ * Последняя вершина каждой части может быть заполнена не полностью
+ * @param text Текст
+ * @param threads Количество потоков разбора
+ * @param parse_line Функция разбора строки (line, block, leaves, strings), см. parse_text; strings - область
+ * памяти части для байтов строк char*, для std::string_view и std::string - nullptr (элементы блока ссылаются на
+ * сам текст)
+ * @return Конечные вершины
+ */
+template<typename T, int arr_size, typename Compare>
+template<typename ParseLine>
+std::vector<std::shared_ptr<TreeNode<T>>> Tree<T, arr_size, Compare>::parse_text_parts(const std::string_view text,
+                                                                                const size_t threads,
+                                                                                ParseLine parse_line) const {
+    const size_t part_size = std::max<size_t>(TEXT_BLOCK_SIZE, text.size() / (4 * threads) + 1);
+    std::vector<std::string_view> parts;
+    for (size_t begin = 0; begin < text.size();) {
+        size_t end = text.find('\n', std::min(text.size(), begin + part_size));
+        end = end == std::string_view::npos ? text.size() : end + 1;
+        parts.push_back(text.substr(begin, end - begin));
+        begin = end;
+    }
+
+    struct Part {
+        std::vector<std::shared_ptr<TreeNode<T>>> leaves;
+        StringArena strings;
+    };
+    auto parse_part = [this, &parse_line](const std::string_view part_text, Part &part) {
+        StringArena *strings = std::is_same_v<TextElement, std::string_view> ? nullptr : &part.strings;
+        std::vector<TextElement> block;
+        block.reserve(arr_size);
+        for (size_t begin = 0; begin < part_text.size();) {
+            size_t end = part_text.find('\n', begin);
+            end = end == std::string_view::npos ? part_text.size() : end;
+            parse_line(part_text.substr(begin, end - begin), block, part.leaves, strings);
+            begin = end + 1;
+        }
+        flush_text_block(block, part.leaves);
+    };
+
+    std::vector<Part> results(parts.size());
+    std::vector<std::future<void>> workers;
+    for (size_t worker = 0; worker < std::min(threads, parts.size()); ++worker) {
+        workers.push_back(std::async(std::launch::async, [&, worker] {
+            for (size_t i = worker; i < parts.size(); i += threads) {
+                parse_part(parts[i], results[i]);
+            }
+        }));
+    }
+    for (auto &worker: workers) {
+        worker.get();
+    }
+
+    std::vector<std::shared_ptr<TreeNode<T>>> leaves;
+    for (auto &part: results) {
+        leaves.insert(leaves.end(), std::make_move_iterator(part.leaves.begin()),
+                      std::make_move_iterator(part.leaves.end()));
+    }
+    return leaves;
+}
+
+/**
+ * @brief Функция разбирает одну строку текстового формата, элементы строк LeafNode дописываются в блок,
+ * заполненный блок становится конечной вершиной. Как и при чтении через operator>>, разбор строки прекращается
+ * на первом слове, которое не является значением типа T
+ * @param line Строка без перевода строки
+ * @param block Элементы текущей незаполненной вершины
+ * @param leaves Готовые конечные вершины
+ * @param strings Область памяти для байтов строк, nullptr - элементы std::string_view ссылаются на line
+ */
+template<typename T, int arr_size, typename Compare>
+void Tree<T, arr_size, Compare>::parse_text(std::string_view line, std::vector<TextElement> &block,
+                                   std::vector<std::shared_ptr<TreeNode<T>>> &leaves, StringArena *strings) const {
+    while (!line.empty() && is_text_space(line.front())) {
+        line.remove_prefix(1);
+    }
+    if (line.substr(0, TEXT_LEAF_PREFIX.size()) != TEXT_LEAF_PREFIX) {
+        return;
+    }
+    line.remove_prefix(TEXT_LEAF_PREFIX.size());
+    if (!line.empty() && !is_text_space(line.front())) {
+        return;
+    }
+
+    for_each_token(line, [&](const std::string_view token) {
+        TextElement element{};
+        if (!parse_token(token, element, strings)) {
+            return false;
+        }
+        add_text_element(std::move(element), block, leaves);
+        return true;
+    });
+}
+
+/**
+ * @brief Функция разбирает одно слово в элемент (см. parse_text_element)
+ * @param token Слово
+ * @param element Результат
+ * @param strings Область памяти для байтов строк, nullptr (только для std::string_view и std::string) - элемент
+ * ссылается на байты token без копирования
+ * @return false - если слово не является значением типа T
+ */
+template<typename T, int arr_size, typename Compare>
+bool Tree<T, arr_size, Compare>::parse_token(const std::string_view token, TextElement &element, StringArena *strings) {
+    if constexpr (std::is_same_v<TextElement, std::string_view>) {
+        if (!strings) {
+            element = token;
+            return true;
+        }
+    }
+    return parse_text_element(token, element, *strings);
+}
+
+/**
+ * @brief Функция дописывает элемент в блок, заполненный блок становится конечной вершиной
+ */
+template<typename T, int arr_size, typename Compare>
+void Tree<T, arr_size, Compare>::add_text_element(TextElement element, std::vector<TextElement> &block,
+                                         std::vector<std::shared_ptr<TreeNode<T>>> &leaves) const {
+    block.push_back(std::move(element));
+    if (block.size() == static_cast<size_t>(arr_size)) {
+        flush_text_block(block, leaves);
+    }
+}
+
+/**
+ * @brief Функция превращает непустой блок элементов в конечную вершину
+ */
+template<typename T, int arr_size, typename Compare>
+void Tree<T, arr_size, Compare>::flush_text_block(std::vector<TextElement> &block,
+                                         std::vector<std::shared_ptr<TreeNode<T>>> &leaves) const {
+    if (block.empty()) {
+        return;
+    }
+    auto leaf = make_leaf();
+    leaf->assign(std::make_move_iterator(block.begin()), block.size());
+    leaves.push_back(leaf);
+    block.clear();
 }
 
 /**
  * @brief Функция для вывода дерева в понятном для восприятия формате
  */
-template<typename T, int arr_size>
-void Tree<T, arr_size>::print_helper() {
-    if (!root) {
-        std::cout << "Empty Tree" << std::endl;
+template<typename T, int arr_size, typename Compare>
+void Tree<T, arr_size, Compare>::print_helper() {
+    if (!root) {
+        std::cout << "Empty Tree" << std::endl;
+        return;
+    }
+
+    std::queue<std::shared_ptr<TreeNode<T>> > queue;
+    queue.push(root);
+    std::string line;
+
+    while (!queue.empty()) {
+        const size_t level_size = queue.size();
+
+        for (size_t i = 0; i < level_size; ++i) {
+            auto current = queue.front();
+            queue.pop();
+            if (!current) {
+                continue;
+            }
+
+            if (current->get_type() == TYPE::LEAF) {
+                auto leaf = std::static_pointer_cast<LeafNode<T, arr_size> >(current);
+                line += '[';
+                for (size_t j = 0; j < leaf->get_size(); ++j) {
+                    append_text_element(line, leaf->element_view(j));
+                    if (j + 1 < leaf->get_size()) line += ", ";
+                }
+                line += "] ";
+            } else if (current->get_type() == TYPE::INTERMEDIATE) {
+                line += "INT ";
+                auto intermediate = std::static_pointer_cast<IntermediateNode<T, arr_size> >(current);
+                queue.push(intermediate->get_left_node());
+                queue.push(intermediate->get_right_node());
+            }
+        }
+        line += '\n';
+        std::cout << line;
+        line.clear();
+    }
+}
+
+template<typename T, int arr_size, typename Compare>
+bool Tree<T, arr_size, Compare>::insert_by_index(size_t index, const T &element) {
+    return insert_helper(root, index, stored(element));
+}
+
+template<typename T, int arr_size, typename Compare>
+bool Tree<T, arr_size, Compare>::remove_by_index(const size_t index) {
+    return remove_helper(root, index);
+}
+
+template<typename T, int arr_size, typename Compare>
+bool Tree<T, arr_size, Compare>::insert_with_order_save(T element) {
+    element = stored(element);
+    if (!root) {
+        auto new_leaf = make_leaf();
+        new_leaf->add_element(element);
+        root = new_leaf;
+        return true;
+    }
+    if (!isTreeSorted) {
+        std::cout << "Cannot insert value with order save in not sorted tree\n";
+        return false;
+    }
+
+    return insert_with_order_helper(root, element);
+}
+
+template<typename T, int arr_size, typename Compare>
+void Tree<T, arr_size, Compare>::clear_with_struct() {
+    traverse(root, [](const std::shared_ptr<TreeNode<T>> &node) {
+        if (node->get_type() == TYPE::LEAF) {
+            auto leaf = std::dynamic_pointer_cast<LeafNode<T, arr_size> >(node);
+            leaf->clear_elements();
+        }
+    });
+}
+
+template<typename T, int arr_size, typename Compare>
+template<typename It>
+void Tree<T, arr_size, Compare>::distribute_elements(const std::shared_ptr<TreeNode<T>> &node,
+                                            It &it,
+                                            const size_t elements_per_leaf,
+                                            size_t &remaining_elements) {
+    if (!node) {
+        return;
+    }
+
+    if (node->get_type() == TYPE::LEAF) {
+        auto leaf = std::dynamic_pointer_cast<LeafNode<T, arr_size>>(node);
+        if (!leaf) {
+            throw std::runtime_error("Failed to cast to LeafNode");
+        }
+
+        const size_t count = std::min({elements_per_leaf, remaining_elements, static_cast<size_t>(arr_size)});
+        leaf->assign(it, count);
+        std::advance(it, count);
+        remaining_elements -= count;
+
+        return;
+    }
+
+    auto intermediate = std::dynamic_pointer_cast<IntermediateNode<T, arr_size>>(node);
+    if (!intermediate) {
+        throw std::runtime_error("Failed to cast to IntermediateNode");
+    }
+
+    distribute_elements(intermediate->get_left_node(), it, elements_per_leaf, remaining_elements);
+    distribute_elements(intermediate->get_right_node(), it, elements_per_leaf, remaining_elements);
+}
+
+template<typename T, int arr_size, typename Compare>
+T Tree<T, arr_size, Compare>::get_by_index_helper(std::shared_ptr<TreeNode<T>> node, size_t index) const {
+    if (!node) {
+        throw std::out_of_range("Index out of bounds");
+    }
+
+    if (node->get_type() == TYPE::LEAF) {
+        if (auto leaf = std::dynamic_pointer_cast<LeafNode<T, arr_size>>(node); index < leaf->get_size()) {
+            return leaf->get_element_at(index);
+        } else {
+            throw std::out_of_range("Index out of bounds");
+        }
+    }
+
+    if (node->get_type() == TYPE::INTERMEDIATE) {
+        auto intermediate = std::dynamic_pointer_cast<IntermediateNode<T, arr_size>>(node);
+
+        if (const size_t left_size = intermediate->get_left_node()->get_size(); index < left_size) {
+            return get_by_index_helper(intermediate->get_left_node(), index);
+        } else {
+            return get_by_index_helper(intermediate->get_right_node(), index - left_size);
+        }
+    }
+
+    throw std::runtime_error("Unexpected node type");
+}
+
+template<typename T, int arr_size, typename Compare>
+bool Tree<T, arr_size, Compare>::insert_with_order_helper(std::shared_ptr<TreeNode<T>> &node, const T &element) {
+    unshare(node);
+    if (node->get_type() == TYPE::LEAF) {
+        auto leaf = std::dynamic_pointer_cast<LeafNode<T, arr_size>>(node);
+
+        const size_t pos = leaf->lower_bound(
+            element, [this](const auto &left, const auto &right) { return less(left, right); });
+
+        if (!leaf->insert_by_index(pos, element)) {
+            const size_t mid = arr_size / 2;
+
+            auto new_left_node = make_leaf();
+            auto new_right_node = make_leaf();
+
+            for (size_t i = 0; i < mid; ++i) {
+                new_left_node->add_element(leaf->get_element_at(i));
+            }
+            for (size_t i = mid; i < leaf->get_size(); ++i) {
+                new_right_node->add_element(leaf->get_element_at(i));
+            }
+
+            if (pos < mid) {
+                new_left_node->insert_by_index(pos, element);
+            } else {
+                new_right_node->insert_by_index(pos - mid, element);
+            }
+
+            auto intermediate = std::make_shared<IntermediateNode<T, arr_size>>();
+            intermediate->set_left_node(new_left_node);
+            intermediate->set_right_node(new_right_node);
+
+            node = intermediate;
+        }
+        return true;
+    }
+
+    if (node->get_type() == TYPE::INTERMEDIATE) {
+        auto intermediate = std::dynamic_pointer_cast<IntermediateNode<T, arr_size>>(node);
+
+        const bool result = goes_left(intermediate, element)
+                                ? insert_with_order_helper(intermediate->get_left_node(), element)
+                                : insert_with_order_helper(intermediate->get_right_node(), element);
+        intermediate->update_size();
+        return result;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Функция применяет пакет изменений за один спуск по дереву
+ * номера во всех изменениях относятся к дереву до применения пакета: несколько включений с одним номером
+ * выполняются в порядке следования в пакете перед элементом с этим номером, а номер, равный размеру дерева,
+ * означает конец. Удаление по значению затрагивает исходные элементы и элементы, добавленные раньше него в пакете
+ *
+ * изменения по номеру упорядочиваются и спускаются от корня вместе, поддерево без изменений остаётся на месте
+ * (и разделяется с копиями дерева), а изменённые конечные вершины перестраиваются и собираются через join,
+ * поэтому пакет из k изменений по номеру стоит O(k (log n + arr_size)). Удаление по значению просматривает все
+ * конечные вершины, но перестраивает только те, в которых есть удаляемые значения
+ * @param operations Вектор изменений
+ * @return true если пакет применён
+ */
+template<typename T, int arr_size, typename Compare>
+bool Tree<T, arr_size, Compare>::apply_batch(const std::vector<Operation<T>> &operations) {
+    const size_t total = size();
+
+    std::vector<BatchOperation> positional;
+    RemovedValues removed_values;
+    std::vector<size_t> appended;
+    bool has_insert = false;
+
+    for (size_t i = 0; i < operations.size(); ++i) {
+        const auto &operation = operations[i];
+        switch (operation.type) {
+            case OPERATION::INSERT:
+                appended.push_back(i);
+                has_insert = true;
+                break;
+            case OPERATION::INSERT_BY_INDEX:
+                if (operation.index > total) {
+                    throw std::out_of_range("Index out of bounds");
+                }
+                positional.push_back({operation.index, i, true, &operation.value});
+                has_insert = true;
+                break;
+            case OPERATION::REMOVE:
+                removed_values.emplace_back(operation.value, i);
+                break;
+            case OPERATION::REMOVE_BY_INDEX:
+                if (operation.index >= total) {
+                    throw std::out_of_range("Index out of bounds");
+                }
+                positional.push_back({operation.index, i, false, &operation.value});
+                break;
+        }
+    }
+
+    std::stable_sort(positional.begin(), positional.end(), [](const BatchOperation &a, const BatchOperation &b) {
+        return a.index < b.index;
+    });
+    // добавления в конец идут после всех включений с номером, равным размеру дерева
+    for (const size_t sequence: appended) {
+        positional.push_back({total, sequence, true, &operations[sequence].value});
+    }
+    // для каждого значения достаточно помнить последнее удаление в пакете
+    std::sort(removed_values.begin(), removed_values.end(), [this](const auto &a, const auto &b) {
+        return removal_less(a.first, b.first) || (!removal_less(b.first, a.first) && a.second > b.second);
+    });
+    removed_values.erase(std::unique(removed_values.begin(), removed_values.end(), [this](const auto &a, const auto &b) {
+        return equivalent(a.first, b.first);
+    }), removed_values.end());
+
+    root = apply_batch_helper(root, 0, positional.data(), positional.data() + positional.size(), removed_values);
+    if (has_insert) {
+        isTreeSorted = false;
+    }
+    return true;
+}
+
+/**
+ * @brief Функция проверяет, удаляет ли пакет значение
+ * @param removed_values Упорядоченные удаления по значению с номером последнего удаления в пакете
+ * @param value Значение
+ * @param sequence Номер включения значения в пакете, SIZE_MAX - для исходных элементов дерева
+ */
+template<typename T, int arr_size, typename Compare>
+template<typename Element>
+bool Tree<T, arr_size, Compare>::is_batch_removed(const RemovedValues &removed_values, const Element &value,
+                                                  const size_t sequence) const {
+    auto it = std::lower_bound(removed_values.begin(), removed_values.end(), value,
+                               [this](const auto &entry, const Element &key) { return removal_less(entry.first, key); });
+    return it != removed_values.end() && equivalent(value, it->first) &&
+           (sequence == SIZE_MAX || it->second > sequence);
+}
+
+/**
+ * @brief Рекурсивная функция применения пакета к поддереву
+ * @param node Указатель на вершину поддерева (может быть nullptr у пустого дерева)
+ * @param offset Номер первого элемента поддерева
+ * @param begin, end Изменения по номеру, попадающие в поддерево, упорядоченные по номеру
+ * @param removed_values Удаления по значению
+ * @return Вершина на месте node: сама node, если поддерево не изменилось, иначе новая вершина
+ */
+template<typename T, int arr_size, typename Compare>
+std::shared_ptr<TreeNode<T>> Tree<T, arr_size, Compare>::apply_batch_helper(
+    const std::shared_ptr<TreeNode<T>> &node, const size_t offset, const BatchOperation *begin,
+    const BatchOperation *end, const RemovedValues &removed_values) {
+    if (begin == end && (removed_values.empty() || !node)) {
+        return node;
+    }
+
+    if (node && node->get_type() == TYPE::INTERMEDIATE) {
+        auto intermediate = std::static_pointer_cast<IntermediateNode<T, arr_size>>(node);
+        const size_t left_size = intermediate->get_left_size();
+        // включение перед первым элементом правого поддерева выполняется в правом поддереве
+        const BatchOperation *middle = std::partition_point(begin, end, [&](const BatchOperation &operation) {
+            return operation.index < offset + left_size;
+        });
+        auto left = apply_batch_helper(intermediate->get_left_node(), offset, begin, middle, removed_values);
+        auto right = apply_batch_helper(intermediate->get_right_node(), offset + left_size, middle, end,
+                                        removed_values);
+        if (left == intermediate->get_left_node() && right == intermediate->get_right_node()) {
+            return node;
+        }
+        return join(left, right);
+    }
+
+    auto leaf = std::static_pointer_cast<LeafNode<T, arr_size>>(node);
+    const size_t count = leaf ? leaf->get_size() : 0;
+    if (begin == end) {
+        bool has_removed = false;
+        for (size_t i = 0; i < count && !has_removed; ++i) {
+            has_removed = is_batch_removed(removed_values, leaf->element_view(i), SIZE_MAX);
+        }
+        if (!has_removed) {
+            return node;
+        }
+    }
+
+    std::vector<T> result;
+    result.reserve(count + (end - begin));
+    auto emit = [&](const T &value, const size_t sequence) {
+        if (removed_values.empty() || !is_batch_removed(removed_values, value, sequence)) {
+            result.push_back(value);
+        }
+    };
+
+    const BatchOperation *operation = begin;
+    for (size_t i = 0; i <= count; ++i) {
+        bool is_erased = false;
+        for (; operation != end && operation->index == offset + i; ++operation) {
+            if (operation->is_insert) {
+                emit(stored(*operation->value), operation->sequence);
+            } else {
+                is_erased = true;
+            }
+        }
+        if (i < count && !is_erased) {
+            emit(leaf->get_element_at(i), SIZE_MAX);
+        }
+    }
+    return build_subtree(result);
+}
+
+/**
+ * @brief Функция собирает поддерево из двух поддеревьев, все элементы left идут перед элементами right
+ * если высоты отличаются больше чем на 1, right подвешивается к правой ветви left (или left к левой ветви right)
+ * на уровне, где высоты сравнимы, а на обратном пути выполняются повороты (как при соединении AVL-деревьев),
+ * поэтому высота результата не больше max(высота left, высота right) + 1 и стоимость - O(разность высот).
+ * Существующие вершины не изменяются: новые вершины создаются только на пути соединения
+ * @param left Левое поддерево (может быть nullptr)
+ * @param right Правое поддерево (может быть nullptr)
+ * @return Указатель на вершину поддерева
+ */
+template<typename T, int arr_size, typename Compare>
+std::shared_ptr<TreeNode<T>> Tree<T, arr_size, Compare>::join(const std::shared_ptr<TreeNode<T>> &left,
+                                                              const std::shared_ptr<TreeNode<T>> &right) const {
+    if (!left || !right) {
+        return left ? left : right;
+    }
+    const size_t left_height = left->get_height();
+    const size_t right_height = right->get_height();
+    if (left_height > right_height + 1) {
+        auto node = std::static_pointer_cast<IntermediateNode<T, arr_size>>(left);
+        return balanced(node->get_left_node(), join(node->get_right_node(), right));
+    }
+    if (right_height > left_height + 1) {
+        auto node = std::static_pointer_cast<IntermediateNode<T, arr_size>>(right);
+        return balanced(join(left, node->get_left_node()), node->get_right_node());
+    }
+    return make_intermediate(left, right);
+}
+
+/**
+ * @brief Функция создаёт промежуточную вершину над поддеревьями, высоты которых отличаются не больше чем на 2,
+ * и одним или двумя поворотами выравнивает их до разности не больше 1
+ * @param left Левое поддерево (может быть nullptr)
+ * @param right Правое поддерево (может быть nullptr)
+ * @return Указатель на вершину поддерева
+ */
+template<typename T, int arr_size, typename Compare>
+std::shared_ptr<TreeNode<T>> Tree<T, arr_size, Compare>::balanced(const std::shared_ptr<TreeNode<T>> &left,
+                                                                  const std::shared_ptr<TreeNode<T>> &right) const {
+    const size_t left_height = left ? left->get_height() : 0;
+    const size_t right_height = right ? right->get_height() : 0;
+    if (right_height > left_height + 1) {
+        auto node = std::static_pointer_cast<IntermediateNode<T, arr_size>>(right);
+        const auto &inner = node->get_left_node();
+        const auto &outer = node->get_right_node();
+        if (inner && outer && inner->get_height() > outer->get_height()) {
+            auto middle = std::static_pointer_cast<IntermediateNode<T, arr_size>>(inner);
+            return make_intermediate(make_intermediate(left, middle->get_left_node()),
+                                     make_intermediate(middle->get_right_node(), outer));
+        }
+        return make_intermediate(make_intermediate(left, inner), outer);
+    }
+    if (left_height > right_height + 1) {
+        auto node = std::static_pointer_cast<IntermediateNode<T, arr_size>>(left);
+        const auto &outer = node->get_left_node();
+        const auto &inner = node->get_right_node();
+        if (inner && outer && inner->get_height() > outer->get_height()) {
+            auto middle = std::static_pointer_cast<IntermediateNode<T, arr_size>>(inner);
+            return make_intermediate(make_intermediate(outer, middle->get_left_node()),
+                                     make_intermediate(middle->get_right_node(), right));
+        }
+        return make_intermediate(outer, make_intermediate(inner, right));
+    }
+    return make_intermediate(left, right);
+}
+
+/**
+ * @brief Функция создаёт промежуточную вершину над двумя поддеревьями; если одного из них нет, возвращает другое
+ */
+template<typename T, int arr_size, typename Compare>
+std::shared_ptr<TreeNode<T>> Tree<T, arr_size, Compare>::make_intermediate(
+    const std::shared_ptr<TreeNode<T>> &left, const std::shared_ptr<TreeNode<T>> &right) const {
+    if (!left || !right) {
+        return left ? left : right;
+    }
+    auto intermediate = std::make_shared<IntermediateNode<T, arr_size>>();
+    intermediate->set_left_node(left);
+    intermediate->set_right_node(right);
+    return intermediate;
+}
+
+/**
+ * @brief Функция балансировки - выравнивает размерности конечных вершин и высоту поддеревьев
+ */
+template<typename T, int arr_size, typename Compare>
+void Tree<T, arr_size, Compare>::balance() {
+    std::vector<T> elements;
+    elements.reserve(size());
+    for_each([&](const T &element) { elements.push_back(element); });
+    build_from_elements(elements);
+}
+
+/**
+ * @brief Функция строит сбалансированное дерево снизу вверх
+ * элементы поровну распределяются по минимальному количеству конечных вершин, затем вершины попарно
+ * объединяются промежуточными
+ * @param elements Элементы в порядке логической нумерации
+ */
+template<typename T, int arr_size, typename Compare>
+void Tree<T, arr_size, Compare>::build_from_elements(const std::vector<T> &elements) {
+    root = build_subtree(elements);
+}
+
+/**
+ * @brief Функция строит сбалансированное поддерево из элементов, не изменяя дерево
+ * @param elements Элементы в порядке логической нумерации
+ * @return Указатель на вершину поддерева или nullptr, если элементов нет
+ */
+template<typename T, int arr_size, typename Compare>
+std::shared_ptr<TreeNode<T>> Tree<T, arr_size, Compare>::build_subtree(const std::vector<T> &elements) const {
+    if (elements.empty()) {
+        return nullptr;
+    }
+
+    const size_t leaf_count = (elements.size() + arr_size - 1) / arr_size;
+    const size_t per_leaf = elements.size() / leaf_count;
+    size_t remainder = elements.size() % leaf_count;
+
+    std::vector<std::shared_ptr<TreeNode<T>>> leaves;
+    leaves.reserve(leaf_count);
+    auto it = elements.begin();
+    for (size_t i = 0; i < leaf_count; ++i) {
+        auto leaf = make_leaf();
+        const size_t count = per_leaf + (remainder > 0 ? 1 : 0);
+        if (remainder > 0) {
+            --remainder;
+        }
+        for (size_t j = 0; j < count; ++j, ++it) {
+            leaf->add_element(*it);
+        }
+        leaves.push_back(leaf);
+    }
+
+    return build_helper(leaves, 0, leaves.size());
+}
+
+/**
+ * @brief Рекурсивная функция, объединяющая последовательность вершин в сбалансированное поддерево
+ * @param nodes Вершины в порядке логической нумерации
+ * @param begin Начало диапазона
+ * @param end Конец диапазона (не включительно)
+ * @return Указатель на вершину поддерева
+ */
+template<typename T, int arr_size, typename Compare>
+std::shared_ptr<TreeNode<T>> Tree<T, arr_size, Compare>::build_helper(const std::vector<std::shared_ptr<TreeNode<T>>> &nodes,
+                                                             const size_t begin, const size_t end) const {
+    if (end - begin == 1) {
+        return nodes[begin];
+    }
+
+    const size_t mid = begin + (end - begin) / 2;
+    auto intermediate = std::make_shared<IntermediateNode<T, arr_size>>();
+    intermediate->set_left_node(build_helper(nodes, begin, mid));
+    intermediate->set_right_node(build_helper(nodes, mid, end));
+    return intermediate;
+}
+
+/**
+ * @brief Функция добавляет элементы в конец дерева одной операцией
+ * из элементов строится сбалансированное поддерево, которое подвешивается к правой ветви на том уровне,
+ * где размер поддерева сравним с размером присоединяемого, поэтому высота дерева растёт логарифмически
+ * @param elements Элементы которые необходимо добавить
+ * @return true если добавление прошло успешно
+ */
+template<typename T, int arr_size, typename Compare>
+bool Tree<T, arr_size, Compare>::append(const std::vector<T> &elements) {
+    std::shared_ptr<TreeNode<T>> subtree;
+    if constexpr (std::is_same_v<T, std::string_view>) {
+        std::vector<T> copies;
+        copies.reserve(elements.size());
+        for (const auto &element: elements) {
+            copies.push_back(stored(element));
+        }
+        subtree = build_subtree(copies);
+    } else {
+        subtree = build_subtree(elements);
+    }
+    if (!subtree) {
+        return true;
+    }
+    root = root ? append_helper(root, subtree) : subtree;
+    isTreeSorted = false;
+    return true;
+}
+
+/**
+ * @brief Рекурсивная функция для присоединения поддерева к правой ветви
+ * @param node Указатель на вершину дерева
+ * @param subtree Указатель на присоединяемое поддерево
+ * @return Указатель на новую вершину на месте node
+ */
+template<typename T, int arr_size, typename Compare>
+std::shared_ptr<TreeNode<T>> Tree<T, arr_size, Compare>::append_helper(const std::shared_ptr<TreeNode<T>> &node,
+                                                              const std::shared_ptr<TreeNode<T>> &subtree) {
+    if (node->get_type() == TYPE::INTERMEDIATE && node->get_size() > 2 * subtree->get_size() &&
+        std::static_pointer_cast<IntermediateNode<T, arr_size>>(node)->get_right_node()) {
+        auto intermediate = std::static_pointer_cast<IntermediateNode<T, arr_size>>(unshared(node));
+        intermediate->set_right_node(append_helper(intermediate->get_right_node(), subtree));
+        return intermediate;
+    }
+
+    auto intermediate = std::make_shared<IntermediateNode<T, arr_size>>();
+    intermediate->set_left_node(node);
+    intermediate->set_right_node(subtree);
+    return intermediate;
+}
+
+/**
+ * @brief Рекурсивная функция для пересчёта закэшированных размеров промежуточных вершин
+ * используется после операций, которые изменяют конечные вершины в обход спуска от корня
+ * @param node Указатель на вершину дерева
+ * @return Количество элементов в поддереве
+ */
+template<typename T, int arr_size, typename Compare>
+size_t Tree<T, arr_size, Compare>::recount(const std::shared_ptr<TreeNode<T>> &node) {
+    if (!node) {
+        return 0;
+    }
+    if (node->get_type() == TYPE::INTERMEDIATE) {
+        auto intermediate = std::dynamic_pointer_cast<IntermediateNode<T, arr_size>>(node);
+        recount(intermediate->get_left_node());
+        recount(intermediate->get_right_node());
+        intermediate->update_size();
+    }
+    return node->get_size();
+}
+
+/**
+ * @brief Функция получает элементы по набору логических номеров
+ * несвязанные номера обрабатываются группами: спуски группы продвигаются на один уровень за проход, и для
+ * следующего уровня каждого спуска заранее запрашивается загрузка вершины в кэш, поэтому промахи кэша разных
+ * спусков перекрываются. Упорядоченные номера обрабатываются в get_many_sorted с переиспользованием общего пути
+ * @param indices Массив номеров
+ * @param count Количество номеров
+ * @param out Массив для результатов, не меньше count элементов
+ */
+template<typename T, int arr_size, typename Compare>
+void Tree<T, arr_size, Compare>::get_many(const size_t *indices, const size_t count, T *out) const {
+    if (std::is_sorted(indices, indices + count)) {
+        get_many_sorted(indices, count, out);
         return;
     }
 
-    std::queue<std::shared_ptr<TreeNode<T>> > queue;
-    queue.push(root);
+    constexpr size_t group_size = 16;
+    struct Lane {
+        TreeNode<T> *node;
+        size_t index;
+        bool is_leaf_ready;
+    };
 
-    while (!queue.empty()) {
-        const size_t level_size = queue.size();
+    const size_t total = size();
+    for (size_t first = 0; first < count; first += group_size) {
+        const size_t lanes_count = std::min(group_size, count - first);
+        Lane lanes[group_size];
+        for (size_t i = 0; i < lanes_count; ++i) {
+            if (indices[first + i] >= total) {
+                throw std::out_of_range("Index out of bounds");
+            }
+            lanes[i] = {root.get(), indices[first + i], false};
+        }
 
-        for (size_t i = 0; i < level_size; ++i) {
-            auto current = queue.front();
-            queue.pop();
+        for (size_t active = lanes_count; active > 0;) {
+            active = 0;
+            for (size_t i = 0; i < lanes_count; ++i) {
+                Lane &lane = lanes[i];
+                if (!lane.node) {
+                    continue;
+                }
+                ++active;
+
+                if (lane.node->get_type() == TYPE::LEAF) {
+                    auto leaf = static_cast<LeafNode<T, arr_size> *>(lane.node);
+                    if (lane.is_leaf_ready) {
+                        out[first + i] = leaf->element_view(lane.index);
+                        lane.node = nullptr;
+                    } else {
+                        prefetch(leaf->element_address(lane.index));
+                        lane.is_leaf_ready = true;
+                    }
+                    continue;
+                }
 
-            if (current->get_type() == TYPE::LEAF) {
-                auto leaf = std::dynamic_pointer_cast<LeafNode<T, arr_size> >(current);
-                std::cout << "[";
-                for (size_t j = 0; j < leaf->get_size(); ++j) {
-                    std::cout << leaf->get_element_at(j);
-                    if (j + 1 < leaf->get_size()) std::cout << ", ";
+                auto intermediate = static_cast<IntermediateNode<T, arr_size> *>(lane.node);
+                if (const size_t left_size = intermediate->get_left_size(); lane.index < left_size) {
+                    lane.node = intermediate->get_left_node().get();
+                } else {
+                    lane.index -= left_size;
+                    lane.node = intermediate->get_right_node().get();
                 }
-                std::cout << "] ";
-            } else if (current->get_type() == TYPE::INTERMEDIATE) {
-                std::cout << "INT ";
-                auto intermediate = std::dynamic_pointer_cast<IntermediateNode<T, arr_size> >(current);
-                queue.push(intermediate->get_left_node());
-                queue.push(intermediate->get_right_node());
+                prefetch(lane.node);
             }
         }
-        std::cout << "\n";
     }
 }
 
-template<typename T, int arr_size>
-bool Tree<T, arr_size>::insert_by_index(size_t index, const T &element) {
-    return insert_helper(root, index, element);
-}
-
-template<typename T, int arr_size>
-bool Tree<T, arr_size>::remove_by_index(const size_t index) {
-    return remove_helper(root, index);
+/**
+ * @brief Функция получает элементы по набору номеров и возвращает их в векторе
+ * @param indices Вектор номеров
+ * @return Вектор элементов в порядке номеров
+ */
+template<typename T, int arr_size, typename Compare>
+std::vector<T> Tree<T, arr_size, Compare>::get_many(const std::vector<size_t> &indices) const {
+    std::vector<T> result(indices.size());
+    get_many(indices.data(), indices.size(), result.data());
+    return result;
 }
 
-template<typename T, int arr_size>
-bool Tree<T, arr_size>::insert_with_order_save(T element) {
-    if (!root) {
-        auto new_leaf = std::make_shared<LeafNode<T, arr_size>>();
-        new_leaf->add_element(element);
-        root = new_leaf;
-        return true;
+/**
+ * @brief Функция получает элементы по упорядоченному набору номеров
+ * путь от корня хранится в стеке, и для очередного номера спуск начинается с ближайшей общей вершины, поэтому
+ * номера из одной конечной вершины не требуют спуска вовсе
+ * @param indices Массив номеров, упорядоченный по возрастанию
+ * @param count Количество номеров
+ * @param out Массив для результатов, не меньше count элементов
+ */
+template<typename T, int arr_size, typename Compare>
+void Tree<T, arr_size, Compare>::get_many_sorted(const size_t *indices, const size_t count, T *out) const {
+    if (count > 0 && indices[count - 1] >= size()) {
+        throw std::out_of_range("Index out of bounds");
     }
-    if (!isTreeSorted) {
-        std::cout << "Cannot insert value with order save in not sorted tree\n";
-        return false;
+
+    std::vector<std::pair<TreeNode<T> *, size_t>> path;
+    for (size_t i = 0; i < count; ++i) {
+        const size_t index = indices[i];
+        while (!path.empty() && index >= path.back().second + path.back().first->get_size()) {
+            path.pop_back();
+        }
+        if (path.empty()) {
+            path.emplace_back(root.get(), 0);
+        }
+
+        while (path.back().first->get_type() == TYPE::INTERMEDIATE) {
+            auto intermediate = static_cast<IntermediateNode<T, arr_size> *>(path.back().first);
+            const size_t start = path.back().second;
+            if (const size_t left_size = intermediate->get_left_size(); index < start + left_size) {
+                path.emplace_back(intermediate->get_left_node().get(), start);
+            } else {
+                path.emplace_back(intermediate->get_right_node().get(), start + left_size);
+            }
+        }
+
+        auto leaf = static_cast<LeafNode<T, arr_size> *>(path.back().first);
+        out[i] = leaf->element_view(index - path.back().second);
     }
+}
 
-    return insert_with_order_helper(root, element);
+/**
+ * @brief Функция строит сбалансированное дерево над готовыми конечными вершинами
+ * @param leaves Конечные вершины в порядке логической нумерации
+ */
+template<typename T, int arr_size, typename Compare>
+void Tree<T, arr_size, Compare>::build_from_leaves(const std::vector<std::shared_ptr<TreeNode<T>>> &leaves) {
+    root = leaves.empty() ? nullptr : build_helper(leaves, 0, leaves.size());
+    isTreeSorted = false;
 }
 
-template<typename T, int arr_size>
-void Tree<T, arr_size>::clear_with_struct() {
-    traverse(root, [](const std::shared_ptr<TreeNode<T>> &node) {
-        if (node->get_type() == TYPE::LEAF) {
-            auto leaf = std::dynamic_pointer_cast<LeafNode<T, arr_size> >(node);
-            leaf->clear_elements();
-        }
-    });
+/**
+ * @brief Функция включает подкачку конечных вершин на диск (см. LeafPager): существующие конечные вершины
+ * заменяются вершинами с подкачкой, новые вершины создаются с подкачкой, в памяти остаются не больше
+ * resident_leaves массивов конечных вершин. Дерево с подкачкой используется из одного потока
+ * @param path Путь к файлу подкачки
+ * @param resident_leaves Количество конечных вершин в памяти
+ */
+template<typename T, int arr_size, typename Compare>
+void Tree<T, arr_size, Compare>::enable_paging(const std::string &path, const size_t resident_leaves) {
+    pager = std::make_shared<LeafPager<T, arr_size>>(path, resident_leaves);
+    unshare_all(root);
+    page_leaves(root);
 }
 
-template<typename T, int arr_size>
-void Tree<T, arr_size>::distribute_elements(const std::shared_ptr<TreeNode<T>> &node,
-                                            typename std::vector<T>::iterator &it,
-                                            const size_t elements_per_leaf,
-                                            size_t &remaining_elements) {
+/**
+ * @brief Рекурсивная функция, которая заменяет конечные вершины поддерева вершинами с подкачкой
+ * @param node Указатель на вершину поддерева
+ */
+template<typename T, int arr_size, typename Compare>
+void Tree<T, arr_size, Compare>::page_leaves(std::shared_ptr<TreeNode<T>> &node) const {
     if (!node) {
         return;
     }
+    if (node->get_type() == TYPE::LEAF) {
+        auto leaf = std::static_pointer_cast<LeafNode<T, arr_size>>(node);
+        auto copy = make_leaf();
+        copy->copy_from(*leaf);
+        node = copy;
+        return;
+    }
+    auto intermediate = std::static_pointer_cast<IntermediateNode<T, arr_size>>(node);
+    page_leaves(intermediate->get_left_node());
+    page_leaves(intermediate->get_right_node());
+}
+
+/**
+ * @brief Функция вставляет текст перед позицией offset
+ * @param offset Позиция, от 0 до size()
+ * @param text Текст
+ */
+template<typename T, int arr_size, typename Compare>
+void Tree<T, arr_size, Compare>::insert_text(const size_t offset, const std::string_view text) {
+    static_assert(std::is_same_v<T, char>, "text functions require Tree<char, N>");
+    if (offset > size()) {
+        throw std::out_of_range("Index out of bounds");
+    }
+    if (text.empty()) {
+        return;
+    }
+    if (!root) {
+        root = make_leaf();
+    }
+    root = insert_text_helper(root, offset, text);
+    isTreeSorted = false;
+}
 
+/**
+ * @brief Рекурсивная функция вставки текста: в конечной вершине текст объединяется с её символами, и если они не
+ * помещаются в вершину, вершина заменяется сбалансированным поддеревом из поровну заполненных вершин. На обратном
+ * пути изменённое поддерево присоединяется к соседнему через join_text, поэтому высота дерева остаётся
+ * логарифмической и при многократной вставке в одно место, а конечные вершины заполнены не меньше чем наполовину
+ * @param node Указатель на вершину
+ * @param offset Позиция внутри поддерева
+ * @param text Текст
+ * @return Вершина, заменяющая поддерево
+ */
+template<typename T, int arr_size, typename Compare>
+std::shared_ptr<TreeNode<T>> Tree<T, arr_size, Compare>::insert_text_helper(std::shared_ptr<TreeNode<T>> node,
+                                                                    const size_t offset,
+                                                                    const std::string_view text) const {
+    if (!node) {
+        node = make_leaf();
+    }
     if (node->get_type() == TYPE::LEAF) {
-        auto leaf = std::dynamic_pointer_cast<LeafNode<T, arr_size>>(node);
-        if (!leaf) {
-            throw std::runtime_error("Failed to cast to LeafNode");
+        unshare(node);
+        auto leaf = std::static_pointer_cast<LeafNode<T, arr_size>>(node);
+        const char *data = leaf->raw_data();
+        const size_t leaf_size = leaf->get_size();
+
+        std::string buffer;
+        buffer.reserve(leaf_size + text.size());
+        buffer.append(data, offset).append(text).append(data + offset, leaf_size - offset);
+        if (buffer.size() <= static_cast<size_t>(arr_size)) {
+            leaf->assign(buffer.data(), buffer.size());
+            return node;
         }
 
-        size_t added_elements = 0;
-        while (added_elements < elements_per_leaf && remaining_elements > 0) {
-            leaf->add_element(*it);
-            ++it;
-            ++added_elements;
-            --remaining_elements;
-        }
+        return text_leaves(buffer);
+    }
+
+    auto intermediate = std::static_pointer_cast<IntermediateNode<T, arr_size>>(node);
+    const auto &left = intermediate->get_left_node();
+    const auto &right = intermediate->get_right_node();
+    const size_t left_size = intermediate->get_left_size();
+    if ((offset < left_size && left) || !right) {
+        return join_text(insert_text_helper(left, offset, text), right);
+    }
+    return join_text(left, insert_text_helper(right, offset - left_size, text));
+}
+
+/**
+ * @brief Функция строит сбалансированное поддерево из текста, распределяя символы поровну по минимальному
+ * количеству конечных вершин, поэтому при переполнении каждая вершина заполнена не меньше чем наполовину
+ * @param text Текст
+ * @return Указатель на вершину поддерева или nullptr для пустого текста
+ */
+template<typename T, int arr_size, typename Compare>
+std::shared_ptr<TreeNode<T>> Tree<T, arr_size, Compare>::text_leaves(const std::string_view text) const {
+    if (text.empty()) {
+        return nullptr;
+    }
+    const size_t leaf_count = (text.size() + arr_size - 1) / arr_size;
+    const size_t per_leaf = text.size() / leaf_count;
+    const size_t remainder = text.size() % leaf_count;
+
+    std::vector<std::shared_ptr<TreeNode<T>>> leaves;
+    leaves.reserve(leaf_count);
+    size_t begin = 0;
+    for (size_t i = 0; i < leaf_count; ++i) {
+        const size_t count = per_leaf + (i < remainder ? 1 : 0);
+        auto leaf = make_leaf();
+        leaf->assign(text.data() + begin, count);
+        leaves.push_back(leaf);
+        begin += count;
+    }
+    return build_helper(leaves, 0, leaves.size());
+}
+
+/**
+ * @brief Функция соединяет два поддерева текста: если соседние на стыке конечные вершины заполнены меньше чем
+ * наполовину, их символы объединяются в одну или две поровну заполненные вершины. После вставки или удаления
+ * изменённая вершина всегда оказывается на стыке со своим соседом на уровне её родителя, поэтому недозаполненные
+ * вершины не накапливаются
+ * @param left Левое поддерево (может быть nullptr)
+ * @param right Правое поддерево (может быть nullptr)
+ * @return Указатель на вершину поддерева
+ */
+template<typename T, int arr_size, typename Compare>
+std::shared_ptr<TreeNode<T>> Tree<T, arr_size, Compare>::join_text(const std::shared_ptr<TreeNode<T>> &left,
+                                                                   const std::shared_ptr<TreeNode<T>> &right) const {
+    if (!left || !right) {
+        return left ? left : right;
+    }
+    const auto last = edge_leaf(left, false);
+    const auto first = edge_leaf(right, true);
+    const size_t half = arr_size / 2;
+    if (last->get_size() >= half && first->get_size() >= half) {
+        return join(left, right);
+    }
+    std::string buffer(last->raw_data(), last->get_size());
+    buffer.append(first->raw_data(), first->get_size());
+    return join(join(without_edge_leaf(left, false), text_leaves(buffer)), without_edge_leaf(right, true));
+}
+
+/**
+ * @brief Функция находит первую (is_first) или последнюю конечную вершину непустого поддерева
+ */
+template<typename T, int arr_size, typename Compare>
+std::shared_ptr<LeafNode<T, arr_size>> Tree<T, arr_size, Compare>::edge_leaf(std::shared_ptr<TreeNode<T>> node,
+                                                                             const bool is_first) {
+    while (node->get_type() == TYPE::INTERMEDIATE) {
+        auto intermediate = std::static_pointer_cast<IntermediateNode<T, arr_size>>(node);
+        const auto &near = is_first ? intermediate->get_left_node() : intermediate->get_right_node();
+        node = near ? near : (is_first ? intermediate->get_right_node() : intermediate->get_left_node());
+    }
+    return std::static_pointer_cast<LeafNode<T, arr_size>>(node);
+}
+
+/**
+ * @brief Функция возвращает поддерево без первой (is_first) или последней конечной вершины, не изменяя вершины
+ * исходного поддерева
+ * @return Указатель на вершину поддерева или nullptr, если других вершин нет
+ */
+template<typename T, int arr_size, typename Compare>
+std::shared_ptr<TreeNode<T>> Tree<T, arr_size, Compare>::without_edge_leaf(const std::shared_ptr<TreeNode<T>> &node,
+                                                                           const bool is_first) const {
+    if (!node || node->get_type() == TYPE::LEAF) {
+        return nullptr;
+    }
+    auto intermediate = std::static_pointer_cast<IntermediateNode<T, arr_size>>(node);
+    const auto &left = intermediate->get_left_node();
+    const auto &right = intermediate->get_right_node();
+    if (is_first) {
+        return left ? join(without_edge_leaf(left, true), right) : without_edge_leaf(right, true);
+    }
+    return right ? join(left, without_edge_leaf(right, false)) : without_edge_leaf(left, false);
+}
 
+/**
+ * @brief Функция удаляет count символов, начиная с позиции offset
+ * @param offset Позиция первого удаляемого символа
+ * @param count Количество символов
+ */
+template<typename T, int arr_size, typename Compare>
+void Tree<T, arr_size, Compare>::erase_text(const size_t offset, const size_t count) {
+    static_assert(std::is_same_v<T, char>, "text functions require Tree<char, N>");
+    if (offset > size() || count > size() - offset) {
+        throw std::out_of_range("Index out of bounds");
+    }
+    if (count == 0) {
         return;
     }
+    root = erase_text_helper(root, offset, count);
+}
 
-    auto intermediate = std::dynamic_pointer_cast<IntermediateNode<T, arr_size>>(node);
-    if (!intermediate) {
-        throw std::runtime_error("Failed to cast to IntermediateNode");
+/**
+ * @brief Рекурсивная функция удаления диапазона: поддеревья, целиком лежащие в диапазоне, отбрасываются без
+ * спуска в них, оставшиеся части поддеревьев соединяются через join_text, поэтому дерево остаётся
+ * сбалансированным, а недозаполненные после удаления конечные вершины объединяются с соседними
+ * @param node Указатель на вершину
+ * @param offset Начало диапазона внутри поддерева
+ * @param count Длина диапазона
+ * @return Вершина, заменяющая поддерево, nullptr - если поддерево стало пустым
+ */
+template<typename T, int arr_size, typename Compare>
+std::shared_ptr<TreeNode<T>> Tree<T, arr_size, Compare>::erase_text_helper(std::shared_ptr<TreeNode<T>> node,
+                                                                   const size_t offset, const size_t count) const {
+    if (!node || (offset == 0 && count >= node->get_size())) {
+        return nullptr;
     }
 
-    distribute_elements(intermediate->get_left_node(), it, elements_per_leaf, remaining_elements);
-    distribute_elements(intermediate->get_right_node(), it, elements_per_leaf, remaining_elements);
+    if (node->get_type() == TYPE::LEAF) {
+        unshare(node);
+        auto leaf = std::static_pointer_cast<LeafNode<T, arr_size>>(node);
+        const char *data = leaf->raw_data();
+        std::string kept(data, offset);
+        kept.append(data + offset + count, leaf->get_size() - offset - count);
+        leaf->assign(kept.data(), kept.size());
+        return node;
+    }
+
+    auto intermediate = std::static_pointer_cast<IntermediateNode<T, arr_size>>(node);
+    std::shared_ptr<TreeNode<T>> left = intermediate->get_left_node();
+    std::shared_ptr<TreeNode<T>> right = intermediate->get_right_node();
+    const size_t left_size = intermediate->get_left_size();
+    if (offset < left_size) {
+        left = erase_text_helper(left, offset, std::min(count, left_size - offset));
+    }
+    if (offset + count > left_size) {
+        const size_t begin = std::max(offset, left_size);
+        right = erase_text_helper(right, begin - left_size, offset + count - begin);
+    }
+    return join_text(left, right);
 }
 
-template<typename T, int arr_size>
-T Tree<T, arr_size>::get_by_index_helper(std::shared_ptr<TreeNode<T>> node, size_t index) {
-    if (!node) {
+/**
+ * @brief Функция возвращает count символов, начиная с позиции offset (меньше, если текст кончается раньше)
+ * @param offset Позиция первого символа
+ * @param count Количество символов
+ * @return Подстрока
+ */
+template<typename T, int arr_size, typename Compare>
+std::string Tree<T, arr_size, Compare>::substr(const size_t offset, size_t count) const {
+    static_assert(std::is_same_v<T, char>, "text functions require Tree<char, N>");
+    if (offset > size()) {
         throw std::out_of_range("Index out of bounds");
     }
+    count = std::min(count, size() - offset);
+    std::string out;
+    out.reserve(count);
+    if (count > 0) {
+        substr_helper(root.get(), offset, count, out);
+    }
+    return out;
+}
 
+template<typename T, int arr_size, typename Compare>
+void Tree<T, arr_size, Compare>::substr_helper(TreeNode<T> *node, const size_t offset, const size_t count,
+                                      std::string &out) const {
     if (node->get_type() == TYPE::LEAF) {
-        if (auto leaf = std::dynamic_pointer_cast<LeafNode<T, arr_size>>(node); index < leaf->get_size()) {
-            return leaf->get_element_at(index);
-        } else {
-            throw std::out_of_range("Index out of bounds");
-        }
+        out.append(static_cast<LeafNode<T, arr_size> *>(node)->raw_data() + offset, count);
+        return;
     }
 
-    if (node->get_type() == TYPE::INTERMEDIATE) {
-        auto intermediate = std::dynamic_pointer_cast<IntermediateNode<T, arr_size>>(node);
+    auto intermediate = static_cast<IntermediateNode<T, arr_size> *>(node);
+    const size_t left_size = intermediate->get_left_size();
+    if (offset < left_size) {
+        substr_helper(intermediate->get_left_node().get(), offset, std::min(count, left_size - offset), out);
+    }
+    if (offset + count > left_size) {
+        const size_t begin = std::max(offset, left_size);
+        substr_helper(intermediate->get_right_node().get(), begin - left_size, offset + count - begin, out);
+    }
+}
 
-        if (const size_t left_size = intermediate->get_left_node()->get_size(); index < left_size) {
-            return get_by_index_helper(intermediate->get_left_node(), index);
+/**
+ * @brief Функция возвращает позицию первого символа строки: спуск выбирает поддерево по количеству переводов
+ * строки в левом поддереве, в конечной вершине ищется нужный перевод строки
+ * @param line Номер строки, от 0 до line_count() - 1
+ * @return Позиция
+ */
+template<typename T, int arr_size, typename Compare>
+size_t Tree<T, arr_size, Compare>::line_to_offset(const size_t line) const {
+    static_assert(std::is_same_v<T, char>, "text functions require Tree<char, N>");
+    if (line >= line_count()) {
+        throw std::out_of_range("Line out of bounds");
+    }
+    if (line == 0) {
+        return 0;
+    }
+
+    // ищется перевод строки с номером line (с единицы), строка начинается сразу за ним
+    size_t newline = line;
+    size_t offset = 0;
+    TreeNode<T> *node = root.get();
+    while (node->get_type() == TYPE::INTERMEDIATE) {
+        auto intermediate = static_cast<IntermediateNode<T, arr_size> *>(node);
+        if (newline <= intermediate->get_left_newline_count()) {
+            node = intermediate->get_left_node().get();
         } else {
-            return get_by_index_helper(intermediate->get_right_node(), index - left_size);
+            newline -= intermediate->get_left_newline_count();
+            offset += intermediate->get_left_size();
+            node = intermediate->get_right_node().get();
         }
     }
 
-    throw std::runtime_error("Unexpected node type");
+    const char *data = static_cast<LeafNode<T, arr_size> *>(node)->raw_data();
+    const char *position = data;
+    while (true) {
+        position = static_cast<const char *>(std::memchr(position, '\n', node->get_size() - (position - data)));
+        if (--newline == 0) {
+            return offset + (position - data) + 1;
+        }
+        ++position;
+    }
 }
 
-template<typename T, int arr_size>
-bool Tree<T, arr_size>::insert_with_order_helper(std::shared_ptr<TreeNode<T>> &node, const T &element) {
-    if (node->get_type() == TYPE::LEAF) {
-        auto leaf = std::dynamic_pointer_cast<LeafNode<T, arr_size>>(node);
+/**
+ * @brief Функция возвращает номер строки, в которой лежит позиция: число переводов строки перед позицией
+ * складывается из закэшированных счётчиков левых поддеревьев на пути спуска
+ * @param offset Позиция, от 0 до size()
+ * @return Номер строки
+ */
+template<typename T, int arr_size, typename Compare>
+size_t Tree<T, arr_size, Compare>::offset_to_line(size_t offset) const {
+    static_assert(std::is_same_v<T, char>, "text functions require Tree<char, N>");
+    if (offset > size()) {
+        throw std::out_of_range("Index out of bounds");
+    }
+    if (!root) {
+        return 0;
+    }
 
-        size_t pos = 0;
-        while (pos < leaf->get_size() && leaf->get_element_at(pos) < element) {
-            ++pos;
+    size_t line = 0;
+    TreeNode<T> *node = root.get();
+    while (node->get_type() == TYPE::INTERMEDIATE) {
+        auto intermediate = static_cast<IntermediateNode<T, arr_size> *>(node);
+        if (offset < intermediate->get_left_size() || !intermediate->get_right_node()) {
+            node = intermediate->get_left_node().get();
+        } else {
+            line += intermediate->get_left_newline_count();
+            offset -= intermediate->get_left_size();
+            node = intermediate->get_right_node().get();
         }
+    }
 
-        if (!leaf->insert_by_index(pos, element)) {
-            const size_t mid = arr_size / 2;
+    const char *data = static_cast<LeafNode<T, arr_size> *>(node)->raw_data();
+    return line + std::count(data, data + std::min(offset, node->get_size()), '\n');
+}
+
+/**
+ * @brief Рекурсивная функция обходит символы диапазона [begin, end) по конечным вершинам в порядке текста
+ * @param node Указатель на вершину
+ * @param node_offset Позиция первого символа вершины
+ * @param begin Начало диапазона
+ * @param end Конец диапазона (не включительно)
+ * @param func Функция (data, count, offset), получающая часть вершины внутри диапазона; false - прекратить обход
+ * @return false - если обход прекращён
+ */
+template<typename T, int arr_size, typename Compare>
+template<typename Func>
+bool Tree<T, arr_size, Compare>::scan_leaves(TreeNode<T> *node, const size_t node_offset, const size_t begin,
+                                    const size_t end, Func &func) const {
+    if (!node || node_offset >= end || node_offset + node->get_size() <= begin) {
+        return true;
+    }
+    if (node->get_type() == TYPE::LEAF) {
+        const size_t from = std::max(begin, node_offset) - node_offset;
+        const size_t to = std::min(end, node_offset + node->get_size()) - node_offset;
+        return func(static_cast<LeafNode<T, arr_size> *>(node)->raw_data() + from, to - from, node_offset + from);
+    }
 
-            auto new_left_node = std::make_shared<LeafNode<T, arr_size>>();
-            auto new_right_node = std::make_shared<LeafNode<T, arr_size>>();
+    auto intermediate = static_cast<IntermediateNode<T, arr_size> *>(node);
+    return scan_leaves(intermediate->get_left_node().get(), node_offset, begin, end, func) &&
+           scan_leaves(intermediate->get_right_node().get(), node_offset + intermediate->get_left_size(), begin,
+                       end, func);
+}
 
-            for (size_t i = 0; i < mid; ++i) {
-                new_left_node->add_element(leaf->get_element_at(i));
+/**
+ * @brief Функция ищет вхождения в диапазоне [begin, end) и сообщает о тех, что начинаются раньше limit
+ * вхождения внутри вершины ищутся прямо в её массиве, а вхождения, начинающиеся в последних size() - 1 символах
+ * предыдущих вершин, - в окне из этих символов и начала текущей вершины
+ * @param searcher Образец
+ * @param begin Начало диапазона
+ * @param end Конец диапазона (не включительно)
+ * @param limit Граница начала вхождений
+ * @param report Функция, получающая позицию вхождения в порядке возрастания; false - прекратить поиск
+ */
+template<typename T, int arr_size, typename Compare>
+template<typename Report>
+void Tree<T, arr_size, Compare>::search_range(const TextSearcher &searcher, const size_t begin, const size_t end,
+                                     const size_t limit, Report report) const {
+    const size_t overlap = searcher.size() - 1;
+    std::string carry;
+    std::string window;
+    size_t carry_offset = begin;
+
+    auto scan = [&](const char *data, const size_t count, const size_t offset) {
+        if (!carry.empty()) {
+            window.assign(carry).append(data, std::min(count, overlap));
+            for (size_t position = searcher.find(window.data(), window.size()); position < carry.size();
+                 position = searcher.find(window.data(), window.size(), position + 1)) {
+                if (carry_offset + position >= limit || !report(carry_offset + position)) {
+                    return false;
+                }
             }
-            for (size_t i = mid; i < leaf->get_size(); ++i) {
-                new_right_node->add_element(leaf->get_element_at(i));
+        }
+        for (size_t position = searcher.find(data, count); position != std::string::npos;
+             position = searcher.find(data, count, position + 1)) {
+            if (offset + position >= limit || !report(offset + position)) {
+                return false;
             }
+        }
 
-            if (pos < mid) {
-                new_left_node->insert_by_index(pos, element);
-            } else {
-                new_right_node->insert_by_index(pos - mid, element);
+        if (count >= overlap) {
+            carry.assign(data + count - overlap, overlap);
+            carry_offset = offset + count - overlap;
+        } else {
+            carry.append(data, count);
+            if (carry.size() > overlap) {
+                carry_offset += carry.size() - overlap;
+                carry.erase(0, carry.size() - overlap);
             }
-
-            auto intermediate = std::make_shared<IntermediateNode<T, arr_size>>();
-            intermediate->set_left_node(new_left_node);
-            intermediate->set_right_node(new_right_node);
-
-            node = intermediate;
         }
         return true;
-    }
-
-    if (node->get_type() == TYPE::INTERMEDIATE) {
-        auto intermediate = std::dynamic_pointer_cast<IntermediateNode<T, arr_size>>(node);
+    };
+    scan_leaves(root.get(), 0, begin, end, scan);
+}
 
-        const size_t left_size = intermediate->get_left_node() ? intermediate->get_left_node()->get_size() : 0;
+/**
+ * @brief Функция ищет первое вхождение подстроки, начинающееся не раньше позиции from
+ * @param pattern Подстрока
+ * @param from Позиция начала поиска
+ * @return Позиция вхождения или std::string::npos
+ */
+template<typename T, int arr_size, typename Compare>
+size_t Tree<T, arr_size, Compare>::find(const std::string_view pattern, const size_t from) const {
+    static_assert(std::is_same_v<T, char>, "text functions require Tree<char, N>");
+    const TextSearcher searcher(pattern);
+    size_t result = std::string::npos;
+    if (searcher.size() > 0 && from < size()) {
+        search_range(searcher, from, size(), size(), [&result](const size_t position) {
+            result = position;
+            return false;
+        });
+    }
+    return result;
+}
 
-        if (element <= intermediate->get_left_node()->get_max_value()) {
-            return insert_with_order_helper(intermediate->get_left_node(), element);
-        } else {
-            return insert_with_order_helper(intermediate->get_right_node(), element);
-        }
+/**
+ * @brief Функция возвращает позиции всех вхождений подстроки по возрастанию (вхождения могут перекрываться)
+ * при threads > 1 текст делится на равные части, и каждая часть ищет в своём потоке вхождения, которые в ней
+ * начинаются, просматривая size() - 1 символов следующей части, поэтому вхождения на границах частей не теряются
+ * @param pattern Подстрока
+ * @param threads Количество потоков поиска
+ * @return Позиции вхождений
+ */
+template<typename T, int arr_size, typename Compare>
+std::vector<size_t> Tree<T, arr_size, Compare>::find_all(const std::string_view pattern, size_t threads) const {
+    static_assert(std::is_same_v<T, char>, "text functions require Tree<char, N>");
+    const TextSearcher searcher(pattern);
+    const size_t total = size();
+    if (searcher.size() == 0 || total < searcher.size()) {
+        return {};
+    }
+    if (threads == 0 || pager) {
+        // вершины дерева с подкачкой читаются только из одного потока
+        threads = 1;
+    }
+    threads = std::min(threads, total / std::max<size_t>(TEXT_BLOCK_SIZE / 16, arr_size) + 1);
+
+    auto search_part = [&](const size_t part) {
+        const size_t begin = total / threads * part;
+        const size_t limit = part + 1 == threads ? total : total / threads * (part + 1);
+        std::vector<size_t> positions;
+        search_range(searcher, begin, std::min(total, limit + searcher.size() - 1), limit,
+                     [&positions](const size_t position) {
+                         positions.push_back(position);
+                         return true;
+                     });
+        return positions;
+    };
+    if (threads == 1) {
+        return search_part(0);
     }
 
-    return false;
+    std::vector<std::future<std::vector<size_t>>> parts;
+    for (size_t part = 0; part < threads; ++part) {
+        parts.push_back(std::async(std::launch::async, search_part, part));
+    }
+    std::vector<size_t> result;
+    for (auto &part: parts) {
+        auto positions = part.get();
+        result.insert(result.end(), positions.begin(), positions.end());
+    }
+    return result;
 }
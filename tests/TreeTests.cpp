@@ -0,0 +1,805 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "CheckpointFile.h"
+#include "ConcurrentTree.h"
+#include "DeltaCodec.h"
+#include "IngestQueue.h"
+#include "Journal.h"
+#include "MappedTree.h"
+#include "ShardedTree.h"
+#include "Tree.h"
+
+/**
+ * Регрессионные проверки дерева: каждая функция test_* бросает исключение при ошибке, main выполняет все
+ * проверки и возвращает 1, если хотя бы одна не прошла
+ */
+
+void check(const bool condition, const std::string &message) {
+    if (!condition) {
+        throw std::runtime_error(message);
+    }
+}
+
+template<typename T, int arr_size, typename Compare>
+std::vector<T> elements_of(const Tree<T, arr_size, Compare> &tree) {
+    std::vector<T> elements;
+    tree.for_each([&](const T &element) { elements.push_back(element); });
+    return elements;
+}
+
+/**
+ * @brief balance() строит заполненные вершины, после чего sort() не должен терять элементы
+ */
+void test_balance_then_sort() {
+    std::mt19937 generator(28);
+    for (int count = 1; count <= 200; ++count) {
+        Tree<int, 4> tree;
+        std::vector<int> expected;
+        for (int i = 0; i < count; ++i) {
+            const int value = static_cast<int>(generator() % 1000);
+            tree.insert(value);
+            expected.push_back(value);
+        }
+        tree.balance();
+        tree.sort();
+        std::sort(expected.begin(), expected.end());
+        check(tree.size() == expected.size(), "balance + sort: size " + std::to_string(count));
+        check(elements_of(tree) == expected, "balance + sort: elements " + std::to_string(count));
+    }
+}
+
+/**
+ * @brief apply_batch перестраивает только затронутые вершины, результат совпадает с применением изменений к
+ * вектору, а копия дерева до пакета не меняется
+ */
+void test_apply_batch() {
+    std::mt19937 generator(128);
+    Tree<int, 8> tree;
+    std::vector<int> expected;
+    for (int round = 0; round < 500; ++round) {
+        std::vector<Operation<int>> operations;
+        std::vector<int> result = expected;
+        // изменения по номеру от больших номеров к меньшим, чтобы номера относились к дереву до пакета
+        std::vector<size_t> indices;
+        for (int i = 0; i < 4; ++i) {
+            indices.push_back(generator() % (expected.size() + 1));
+        }
+        std::sort(indices.rbegin(), indices.rend());
+        indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+        for (const size_t index: indices) {
+            const int value = static_cast<int>(generator() % 50);
+            if (index < expected.size() && generator() % 2 == 0) {
+                operations.push_back({OPERATION::REMOVE_BY_INDEX, index, 0});
+                result.erase(result.begin() + static_cast<std::ptrdiff_t>(index));
+            } else {
+                operations.push_back({OPERATION::INSERT_BY_INDEX, index, value});
+                result.insert(result.begin() + static_cast<std::ptrdiff_t>(index), value);
+            }
+        }
+        if (round % 10 == 0) {
+            const int value = static_cast<int>(generator() % 50);
+            operations.push_back({OPERATION::REMOVE, 0, value});
+            result.erase(std::remove(result.begin(), result.end(), value), result.end());
+        }
+
+        const Tree<int, 8> snapshot = tree;
+        tree.apply_batch(operations);
+        check(elements_of(snapshot) == expected, "apply_batch: snapshot changed " + std::to_string(round));
+        check(elements_of(tree) == result, "apply_batch: elements " + std::to_string(round));
+        check(tree.size() == result.size(), "apply_batch: size " + std::to_string(round));
+        expected = result;
+    }
+
+    // удаление по значению сравнивает строки char* по содержимому, как remove
+    char apple[] = "apple";
+    char pear[] = "pear";
+    char other_apple[] = "apple";
+    Tree<char *, 4> strings;
+    strings.insert(apple);
+    strings.insert(pear);
+    Tree<char *, 4> removed = strings;
+    removed.remove(other_apple);
+    strings.apply_batch({{OPERATION::REMOVE, 0, other_apple}});
+    check(removed.size() == 1 && strings.size() == 1, "apply_batch: char* remove");
+    check(std::string(strings.get_by_index(0)) == "pear", "apply_batch: char* element");
+}
+
+/**
+ * @brief remove(value) копирует и помечает изменёнными только путь к изменённой вершине, поэтому следующая
+ * контрольная точка маленькая, а удаление отсутствующего значения не пишет ничего
+ */
+void test_checkpoint_after_remove() {
+    const std::string path = "TreeTests_checkpoint.db";
+    std::remove(path.c_str());
+    Tree<int, 64> tree;
+    std::vector<int> elements(100000);
+    std::iota(elements.begin(), elements.end(), 0);
+    tree.append(elements);
+    {
+        CheckpointFile<int, 64> checkpoint(path);
+        checkpoint.save(tree);
+        const uint64_t full = checkpoint.last_written_bytes();
+        tree.remove(54321);
+        checkpoint.save(tree);
+        check(checkpoint.last_written_bytes() < full / 20, "checkpoint: remove rewrote the tree");
+        tree.remove(-1);
+        checkpoint.save(tree);
+        check(checkpoint.last_written_bytes() == 0, "checkpoint: missing value marked nodes dirty");
+    }
+    Tree<int, 64> loaded;
+    CheckpointFile<int, 64>(path).load(loaded);
+    elements.erase(elements.begin() + 54321);
+    check(elements_of(loaded) == elements, "checkpoint: elements");
+    std::remove(path.c_str());
+}
+
+/**
+ * @brief clone() дерева std::string_view, загруженного из отображённого файла, разделяет отображение, поэтому
+ * копия остаётся читаемой после уничтожения исходного дерева
+ */
+void test_clone_keeps_mapping() {
+    const std::string path = "TreeTests_tokens.txt";
+    std::vector<std::string> expected;
+    {
+        std::ofstream file(path);
+        for (int i = 0; i < 1000; ++i) {
+            expected.push_back("word" + std::to_string(i));
+            file << expected.back() << (i % 10 == 9 ? "\n" : " ");
+        }
+    }
+    Tree<std::string_view, 8> copy;
+    {
+        Tree<std::string_view, 8> tree;
+        tree.load_tokens_from_file(path);
+        copy = tree.clone();
+    }
+    std::remove(path.c_str());
+    const std::vector<std::string_view> elements = elements_of(copy);
+    check(std::equal(elements.begin(), elements.end(), expected.begin(), expected.end()), "clone: elements");
+}
+
+template<int arr_size>
+void check_leaf_fill(const Tree<char, arr_size> &tree, const std::string &message) {
+    check(tree.size() >= tree.leaf_count() * (arr_size / 2),
+          message + ": " + std::to_string(tree.leaf_count()) + " leaves for " + std::to_string(tree.size()));
+}
+
+/**
+ * @brief Многократная вставка и удаление текста не вырождают дерево в список и не дробят текст на мелкие
+ * конечные вершины: высота остаётся логарифмической, а вершины в среднем заполнены не меньше чем наполовину
+ */
+void test_insert_text_stays_balanced() {
+    Tree<char, 64> tree;
+    std::string expected(10000, 'a');
+    for (size_t i = 0; i < expected.size(); ++i) {
+        expected[i] = static_cast<char>('a' + i % 26);
+    }
+    tree.insert_text(0, expected);
+    for (int i = 0; i < 20000; ++i) {
+        tree.insert_text(0, "x");
+        expected.insert(0, "x");
+    }
+    check(tree.height() < 32, "insert_text: height " + std::to_string(tree.height()));
+    check(tree.substr(0, tree.size()) == expected, "insert_text: text");
+    check_leaf_fill(tree, "insert_text at 0: fill");
+
+    std::mt19937 generator(44);
+    for (int i = 0; i < 20000; ++i) {
+        const size_t offset = generator() % (expected.size() + 1);
+        tree.insert_text(offset, "y");
+        expected.insert(offset, "y");
+    }
+    check(tree.substr(0, tree.size()) == expected, "insert_text at random: text");
+    check_leaf_fill(tree, "insert_text at random: fill");
+
+    for (int i = 0; i < 2000; ++i) {
+        const size_t offset = generator() % (expected.size() + 1);
+        const size_t count = std::min<size_t>(generator() % 200, expected.size() - offset);
+        tree.erase_text(offset, count);
+        expected.erase(offset, count);
+        const std::string text(generator() % 100, static_cast<char>('a' + generator() % 26));
+        tree.insert_text(offset, text);
+        expected.insert(offset, text);
+    }
+    check(tree.height() < 32, "erase_text: height " + std::to_string(tree.height()));
+    check(tree.substr(0, tree.size()) == expected, "erase_text: text");
+    check_leaf_fill(tree, "erase_text: fill");
+
+    while (expected.size() > 1000) {
+        const size_t offset = generator() % expected.size();
+        const size_t count = std::min<size_t>(1 + generator() % 5, expected.size() - offset);
+        tree.erase_text(offset, count);
+        expected.erase(offset, count);
+    }
+    check(tree.substr(0, tree.size()) == expected, "erase_text to 1000: text");
+    check_leaf_fill(tree, "erase_text to 1000: fill");
+}
+
+/**
+ * @brief Порядок, принимающий только const std::string &, работает с деревом упакованных строк
+ */
+void test_string_only_compare() {
+    struct ByLength {
+        bool operator()(const std::string &left, const std::string &right) const {
+            return left.size() != right.size() ? left.size() < right.size() : left < right;
+        }
+    };
+    Tree<std::string, 8, ByLength> tree{ByLength{}};
+    std::vector<std::string> expected;
+    for (int i = 0; i < 300; ++i) {
+        expected.emplace_back(i % 23 + 1, static_cast<char>('a' + i % 5));
+        tree.insert(expected.back());
+    }
+    tree.sort();
+    std::sort(expected.begin(), expected.end(), ByLength{});
+    check(elements_of(tree) == expected, "compare: sort");
+
+    const std::string value(4, 'z');
+    tree.insert_with_order_save(value);
+    expected.insert(std::lower_bound(expected.begin(), expected.end(), value, ByLength{}), value);
+    check(elements_of(tree) == expected, "compare: insert_with_order_save");
+
+    const std::string key(3, 'b');
+    const auto position = std::lower_bound(expected.begin(), expected.end(), key, ByLength{});
+    check(tree.lower_bound(key) == static_cast<size_t>(position - expected.begin()), "compare: lower_bound");
+
+    tree.remove(key);
+    expected.erase(std::remove(expected.begin(), expected.end(), key), expected.end());
+    check(elements_of(tree) == expected, "compare: remove");
+}
+
+/**
+ * @brief Распределение по диапазонам хранит диапазоны логических номеров: insert добавляет в конец, rebalance
+ * сохраняет порядок, а глобальные номера переводятся в номера сегментов и при параллельной записи
+ */
+void test_sharded_range_indices() {
+    ShardedTree<int, 8> tree(4, PARTITION::RANGE);
+    for (int i = 0; i < 1000; ++i) {
+        tree.insert(i);
+    }
+    tree.rebalance();
+    tree.insert(1000);
+    for (size_t i = 0; i <= 1000; ++i) {
+        check(tree.get_by_index(i) == static_cast<int>(i), "sharded: index " + std::to_string(i));
+    }
+
+    // писатели 0 и 1 вставляют в начало, 2 и 3 - в конец, читатели обращаются по номерам во время записи
+    constexpr int writers = 4;
+    constexpr int per_writer = 2000;
+    std::vector<std::thread> threads;
+    for (int writer = 0; writer < writers; ++writer) {
+        threads.emplace_back([&tree, writer] {
+            for (int i = 0; i < per_writer; ++i) {
+                const int value = (writer + 1) * 100000 + i;
+                if (writer < 2) {
+                    tree.insert_by_index(0, value);
+                } else {
+                    tree.insert(value);
+                }
+            }
+        });
+    }
+    std::atomic<bool> is_done{false};
+    std::thread reader([&] {
+        while (!is_done.load()) {
+            const size_t size = tree.size();
+            if (size > 0) {
+                tree.get_by_index(size / 2);
+            }
+        }
+    });
+    for (auto &thread: threads) {
+        thread.join();
+    }
+    is_done.store(true);
+    reader.join();
+
+    const size_t total = 1001 + writers * per_writer;
+    check(tree.size() == total, "sharded: size");
+    std::vector<int> elements;
+    tree.for_each([&](const int &element) { elements.push_back(element); });
+    check(elements.size() == total, "sharded: for_each size");
+    for (size_t i = 0; i < total; i += 97) {
+        check(tree.get_by_index(i) == elements[i], "sharded: concurrent index " + std::to_string(i));
+    }
+
+    // исходные элементы остались непрерывным блоком, вставки каждого писателя идут в своём порядке
+    const size_t prefix = 2 * per_writer;
+    for (int i = 0; i <= 1000; ++i) {
+        check(elements[prefix + static_cast<size_t>(i)] == i, "sharded: original block");
+    }
+    std::vector<int> last(writers, -1);
+    for (size_t i = 0; i < total; ++i) {
+        const int writer = elements[i] / 100000 - 1;
+        if (writer < 0) {
+            continue;
+        }
+        const int sequence = elements[i] % 100000;
+        const bool is_prefix = writer < 2;
+        check(is_prefix == (i < prefix), "sharded: writer side");
+        check(last[writer] < 0 || (is_prefix ? sequence == last[writer] - 1 : sequence == last[writer] + 1),
+              "sharded: writer order");
+        last[writer] = sequence;
+    }
+}
+
+void remove_journal(const std::string &path) {
+    std::remove((path + ".journal").c_str());
+    for (int generation = 0; generation < 4; ++generation) {
+        std::remove((path + ".snapshot." + std::to_string(generation)).c_str());
+    }
+}
+
+/**
+ * @brief Журнал дерева std::string_view хранит байты строк, а не указатели: после уничтожения журнала и
+ * исходных строк дерево восстанавливается из снимка и журнала, а недописанная последняя запись отбрасывается
+ */
+void test_journal_recovery() {
+    const std::string path = "TreeTests_journal";
+    remove_journal(path);
+    std::vector<std::string> expected;
+    {
+        Tree<std::string_view, 4> tree;
+        Journal<std::string_view, 4> journal(tree, path, 3);
+        for (int i = 0; i < 20; ++i) {
+            const std::string value = "value" + std::to_string(i);
+            journal.insert(value);
+            expected.push_back(value);
+        }
+        journal.checkpoint();
+        const std::string inserted = "inserted";
+        journal.insert_by_index(5, inserted);
+        expected.insert(expected.begin() + 5, inserted);
+        journal.remove_by_index(0);
+        expected.erase(expected.begin());
+        journal.remove(std::string("value7"));
+        expected.erase(std::find(expected.begin(), expected.end(), "value7"));
+    }
+    {
+        Tree<std::string_view, 4> tree;
+        Journal<std::string_view, 4> journal(tree, path);
+        const std::vector<std::string_view> elements = elements_of(tree);
+        check(std::equal(elements.begin(), elements.end(), expected.begin(), expected.end()), "journal: recovery");
+        journal.insert(std::string("torn"));
+    }
+
+    // обрезанная при сбое последняя запись отбрасывается, а новые записи идут за последней целой
+    const std::string journal_file = path + ".journal";
+    std::ifstream file(journal_file, std::ios::binary | std::ios::ate);
+    const auto size = static_cast<off_t>(file.tellg());
+    file.close();
+    check(::truncate(journal_file.c_str(), size - 3) == 0, "journal: truncate");
+    {
+        Tree<std::string_view, 4> tree;
+        Journal<std::string_view, 4> journal(tree, path);
+        const std::vector<std::string_view> elements = elements_of(tree);
+        check(std::equal(elements.begin(), elements.end(), expected.begin(), expected.end()), "journal: torn tail");
+        journal.insert(std::string("after"));
+        expected.emplace_back("after");
+    }
+    {
+        Tree<std::string_view, 4> tree;
+        Journal<std::string_view, 4> journal(tree, path);
+        const std::vector<std::string_view> elements = elements_of(tree);
+        check(std::equal(elements.begin(), elements.end(), expected.begin(), expected.end()), "journal: append");
+    }
+    remove_journal(path);
+}
+
+/**
+ * @brief remove(value) изменяет вершины на месте только в неразделяемом дереве: копия дерева до удаления и
+ * дерево после него не влияют друг на друга
+ */
+void test_remove_value_copy_on_write() {
+    Tree<int, 8> tree;
+    std::vector<int> elements;
+    for (int i = 0; i < 2000; ++i) {
+        elements.push_back(i % 100);
+    }
+    tree.append(elements);
+    tree.remove(5);
+    std::vector<int> expected = elements;
+    expected.erase(std::remove(expected.begin(), expected.end(), 5), expected.end());
+    check(elements_of(tree) == expected, "remove: in place");
+
+    const Tree<int, 8> copy = tree;
+    tree.remove(7);
+    std::vector<int> removed = expected;
+    removed.erase(std::remove(removed.begin(), removed.end(), 7), removed.end());
+    check(elements_of(copy) == expected, "remove: copy changed");
+    check(elements_of(tree) == removed, "remove: shared tree");
+
+    Tree<int, 8> second = copy;
+    second.remove(9);
+    expected.erase(std::remove(expected.begin(), expected.end(), 9), expected.end());
+    check(elements_of(second) == expected, "remove: second copy");
+    check(elements_of(tree) == removed, "remove: tree changed by copy");
+    check(tree.size() == removed.size() && second.size() == expected.size(), "remove: sizes");
+}
+
+template<typename T>
+void check_delta_round_trip(const std::vector<T> &elements, const std::string &name) {
+    std::vector<uint8_t> bytes;
+    delta_encode(elements.data(), elements.size(), bytes);
+    std::vector<T> decoded(elements.size());
+    delta_decode(bytes.data(), bytes.size(), decoded.data(), decoded.size());
+    check(decoded == elements, "delta: " + name);
+}
+
+template<typename T>
+void check_delta_types(std::mt19937 &random) {
+    const T low = std::numeric_limits<T>::min();
+    const T high = std::numeric_limits<T>::max();
+    std::vector<T> extremes;
+    for (int i = 0; i < 40; ++i) {
+        extremes.push_back(i % 2 == 0 ? low : high);
+        extremes.push_back(i % 3 == 0 ? T(0) : low);
+    }
+    check_delta_round_trip(extremes, "extremes");
+
+    // длинные участки малых разностей обоих знаков, прерванные многобайтовыми
+    std::vector<T> mixed;
+    T value = 0;
+    for (int i = 0; i < 5000; ++i) {
+        if (i % 37 == 0) {
+            value = static_cast<T>(random());
+        } else {
+            value = static_cast<T>(value + static_cast<T>(static_cast<int>(random() % 129) - 64));
+        }
+        mixed.push_back(value);
+    }
+    check_delta_round_trip(mixed, "mixed");
+
+    std::vector<T> descending;
+    for (int i = 0; i < 300; ++i) {
+        descending.push_back(static_cast<T>(high - static_cast<T>(i % 100)));
+    }
+    check_delta_round_trip(descending, "descending");
+
+    for (size_t count = 0; count < 40; ++count) {
+        check_delta_round_trip(std::vector<T>(mixed.begin(), mixed.begin() + count), "short");
+    }
+}
+
+/**
+ * @brief delta_decode восстанавливает элементы всех ширин (векторный разбор однобайтовых разностей и побайтовый
+ * многобайтовых) и отвергает повреждённый блок
+ */
+void test_delta_codec() {
+    std::mt19937 random(34);
+    check_delta_types<int8_t>(random);
+    check_delta_types<uint8_t>(random);
+    check_delta_types<int16_t>(random);
+    check_delta_types<uint16_t>(random);
+    check_delta_types<int32_t>(random);
+    check_delta_types<uint32_t>(random);
+    check_delta_types<int64_t>(random);
+    check_delta_types<uint64_t>(random);
+
+    std::vector<int> elements(100);
+    std::iota(elements.begin(), elements.end(), -50);
+    elements[60] = std::numeric_limits<int>::min();
+    std::vector<uint8_t> bytes;
+    delta_encode(elements.data(), elements.size(), bytes);
+    std::vector<int> decoded(elements.size());
+    const auto rejects = [&](const std::vector<uint8_t> &block) {
+        try {
+            delta_decode(block.data(), block.size(), decoded.data(), decoded.size());
+        } catch (const std::runtime_error &) {
+            return true;
+        }
+        return false;
+    };
+    check(rejects(std::vector<uint8_t>(bytes.begin(), bytes.end() - 1)), "delta: truncated block");
+    std::vector<uint8_t> extra = bytes;
+    extra.push_back(0);
+    check(rejects(extra), "delta: trailing byte");
+    std::vector<uint8_t> unterminated = bytes;
+    unterminated.back() |= 0x80;
+    check(rejects(unterminated), "delta: continuation in last byte");
+    check(rejects(std::vector<uint8_t>(20, 0xFF)), "delta: varint longer than 64 bits");
+}
+
+/**
+ * @brief Читатели ConcurrentTree видят только целые опубликованные версии и не видят версий старее уже
+ * прочитанных: писатель добавляет 0, 1, 2 ... по одному и пачками, читатель проверяет, что размер не убывает и
+ * снимок содержит ровно 0 .. size - 1
+ */
+void test_concurrent_snapshots() {
+    ConcurrentTree<int, 8> tree;
+    constexpr int total = 3000;
+    std::atomic<bool> done(false);
+    std::atomic<int> failures(0);
+
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 3; ++r) {
+        readers.emplace_back([&] {
+            size_t seen = 0;
+            while (!done.load()) {
+                const auto snapshot = tree.snapshot();
+                const size_t size = snapshot->size();
+                int expected = 0;
+                bool consistent = size >= seen;
+                snapshot->for_each([&](const int &element) { consistent = consistent && element == expected++; });
+                if (!consistent || static_cast<size_t>(expected) != size) {
+                    ++failures;
+                }
+                seen = size;
+            }
+        });
+    }
+
+    int next = 0;
+    while (next < total) {
+        if (next % 7 == 0) {
+            tree.write([&](Tree<int, 8> &version) {
+                for (int i = 0; i < 5 && next < total; ++i) {
+                    version.insert(next++);
+                }
+                version.balance();
+            });
+        } else {
+            tree.insert(next++);
+        }
+    }
+    done = true;
+    for (auto &reader: readers) {
+        reader.join();
+    }
+    check(failures == 0, "concurrent: torn or stale snapshot");
+    check(elements_of(*tree.snapshot()).size() == static_cast<size_t>(total), "concurrent: size");
+    check(tree.snapshot()->height() <= 2 * 12, "concurrent: balanced in write");
+}
+
+/**
+ * @brief Дерево с подкачкой (resident_leaves = 8) при случайной смеси изменений совпадает с std::vector: в памяти
+ * остаётся не больше 8 массивов, вытесненные изменённые вершины читаются из файла без потерь, копии дерева до
+ * изменения не меняются
+ */
+void test_paging_random_ops() {
+    const std::string path = "tree_tests_paging.tmp";
+    Tree<int, 8> tree;
+    std::vector<int> expected(200);
+    std::iota(expected.begin(), expected.end(), 0);
+    tree.append(expected);
+    tree.enable_paging(path, 8);
+    const auto *pager = tree.get_pager();
+
+    std::mt19937 random(41);
+    std::vector<std::pair<Tree<int, 8>, std::vector<int> > > copies;
+    for (int step = 0; step < 3000; ++step) {
+        const unsigned op = random() % 100;
+        if (op < 40) {
+            const size_t index = random() % (expected.size() + 1);
+            const int value = static_cast<int>(random() % 1000);
+            tree.insert_by_index(index, value);
+            expected.insert(expected.begin() + static_cast<std::ptrdiff_t>(index), value);
+        } else if (op < 70 && expected.size() > 1) {
+            const size_t index = random() % expected.size();
+            tree.remove_by_index(index);
+            expected.erase(expected.begin() + static_cast<std::ptrdiff_t>(index));
+        } else if (op < 85) {
+            const size_t index = random() % expected.size();
+            check(tree.get_by_index(index) == expected[index], "paging: get_by_index");
+        } else if (op < 90) {
+            const int value = static_cast<int>(random() % 1000);
+            tree.remove(value);
+            expected.erase(std::remove(expected.begin(), expected.end(), value), expected.end());
+        } else if (op < 93) {
+            tree.sort();
+            std::sort(expected.begin(), expected.end());
+        } else if (op < 96) {
+            tree.balance();
+        } else if (copies.size() < 4) {
+            copies.emplace_back(tree, expected);
+        }
+        check(pager->resident_count() <= 8, "paging: resident leaves");
+        check(tree.size() == expected.size(), "paging: size");
+    }
+
+    check(pager->get_writes() > 0 && pager->get_reads() > 0, "paging: no leaves were evicted");
+    check(elements_of(tree) == expected, "paging: elements");
+    for (const auto &[copy, elements]: copies) {
+        check(elements_of(copy) == elements, "paging: copy changed");
+    }
+    check(pager->resident_count() <= 8, "paging: resident leaves after for_each");
+}
+
+/**
+ * @brief Количество строк текстового дерева совпадает с количеством '\n' после любых правок, а правка дерева с
+ * подкачкой не загружает соседние конечные вершины ради подсчёта строк
+ */
+void test_newline_counts() {
+    Tree<char, 64> tree;
+    std::string expected;
+    for (int i = 0; i < 20000; ++i) {
+        expected += i % 37 == 0 ? '\n' : static_cast<char>('a' + i % 26);
+    }
+    tree.insert_text(0, expected);
+    tree.enable_paging("tree_tests_newlines.tmp", 8);
+    const auto *pager = tree.get_pager();
+
+    std::mt19937 generator(144);
+    uint64_t max_reads = 0;
+    for (int i = 0; i < 2000; ++i) {
+        const size_t offset = generator() % (expected.size() + 1);
+        const size_t count = std::min<size_t>(generator() % 50, expected.size() - offset);
+        std::string text(generator() % 50, 'z');
+        for (auto &c: text) {
+            c = generator() % 5 == 0 ? '\n' : 'z';
+        }
+        const uint64_t reads = pager->get_reads();
+        tree.erase_text(offset, count);
+        expected.erase(offset, count);
+        tree.insert_text(offset, text);
+        expected.insert(offset, text);
+        max_reads = std::max(max_reads, pager->get_reads() - reads);
+
+        const size_t lines = std::count(expected.begin(), expected.end(), '\n') + 1;
+        check(tree.line_count() == lines, "newlines: line_count");
+    }
+    check(tree.substr(0, tree.size()) == expected, "newlines: text");
+    check(max_reads <= 4, "newlines: edit read " + std::to_string(max_reads) + " leaves");
+
+    const size_t line = std::count(expected.begin(), expected.begin() + 5000, '\n');
+    check(tree.offset_to_line(5000) == line, "newlines: offset_to_line");
+}
+
+/**
+ * @brief IngestQueue не теряет и не дублирует элементы нескольких производителей, не блокирует push() на время
+ * read() и применяет все элементы при разрушении очереди
+ */
+void test_ingest_queue() {
+    constexpr int producers = 4;
+    constexpr int per_producer = 5000;
+    Tree<int, 16> tree;
+    {
+        IngestQueue<int, 16> queue(tree, 256);
+        std::vector<std::thread> threads;
+        for (int p = 0; p < producers; ++p) {
+            threads.emplace_back([&queue, p] {
+                for (int i = 0; i < per_producer; ++i) {
+                    queue.push(p * per_producer + i);
+                }
+                queue.flush();
+            });
+        }
+        for (auto &thread: threads) {
+            thread.join();
+        }
+        queue.flush();
+
+        std::vector<int> elements;
+        queue.read([&](const Tree<int, 16> &tree) { elements = elements_of(tree); });
+        std::sort(elements.begin(), elements.end());
+        std::vector<int> expected(producers * per_producer);
+        std::iota(expected.begin(), expected.end(), 0);
+        check(elements == expected, "ingest: elements lost or duplicated");
+
+        std::atomic<bool> pushed(false);
+        std::thread producer;
+        queue.read([&](const Tree<int, 16> &) {
+            producer = std::thread([&] {
+                for (int i = 0; i < 1000; ++i) {
+                    queue.push(-1);
+                }
+                pushed = true;
+            });
+            for (int i = 0; i < 5000 && !pushed; ++i) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        });
+        producer.join();
+        check(pushed, "ingest: push blocked by read");
+        queue.flush();
+        queue.read([&](const Tree<int, 16> &tree) { check(tree.size() == expected.size() + 1000, "ingest: size"); });
+
+        for (int i = 0; i < 10000; ++i) {
+            queue.push(i);
+        }
+    }
+    check(tree.size() == producers * per_producer + 11000, "ingest: destructor did not drain the queue");
+}
+
+/**
+ * @brief MappedTree читает сохранённое дерево так же, как исходное, а to_tree() отвергает конечную вершину
+ * снимка больше arr_size
+ */
+void test_mapped_tree() {
+    const std::string path = "tree_tests_mapped.bin";
+    Tree<int, 16> source;
+    std::vector<int> elements(5000);
+    std::mt19937 random(32);
+    for (auto &element: elements) {
+        element = static_cast<int>(random());
+    }
+    source.append(elements);
+    for (int i = 0; i < 300; ++i) {
+        source.remove_by_index(random() % source.size());
+    }
+    {
+        std::ofstream ofs(path, std::ios::binary);
+        source.save_to_binary_file(ofs);
+    }
+    const std::vector<int> expected = elements_of(source);
+
+    {
+        const MappedTree<int, 16> mapped(path);
+        check(mapped.size() == expected.size(), "mapped: size");
+        for (size_t i = 0; i < expected.size(); i += 7) {
+            check(mapped.get_by_index(i) == expected[i], "mapped: get_by_index");
+        }
+        std::vector<int> visited;
+        mapped.for_each([&](const int &element) { visited.push_back(element); });
+        check(visited == expected, "mapped: for_each");
+        const Tree<int, 16> tree = mapped.to_tree();
+        check(elements_of(tree) == expected, "mapped: to_tree");
+        check(elements_of(MappedTree<int, 8>(path).to_tree()) == expected, "mapped: to_tree with other arr_size");
+    }
+
+    // количество элементов первой вершины больше arr_size
+    {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        BinaryFooter footer{};
+        file.seekg(-static_cast<std::streamoff>(sizeof(footer)), std::ios::end);
+        file.read(reinterpret_cast<char *>(&footer), sizeof(footer));
+        uint64_t leaf_offset = 0;
+        file.seekg(static_cast<std::streamoff>(footer.index_offset));
+        file.read(reinterpret_cast<char *>(&leaf_offset), sizeof(leaf_offset));
+        const uint64_t oversize = 17;
+        file.seekp(static_cast<std::streamoff>(leaf_offset));
+        file.write(reinterpret_cast<const char *>(&oversize), sizeof(oversize));
+    }
+    bool rejected = false;
+    try {
+        MappedTree<int, 16>(path).to_tree();
+    } catch (const std::runtime_error &) {
+        rejected = true;
+    }
+    std::remove(path.c_str());
+    check(rejected, "mapped: oversize leaf accepted by to_tree");
+}
+
+int main() {
+    const std::vector<std::pair<const char *, void (*)()>> tests = {
+        {"balance_then_sort", test_balance_then_sort},
+        {"apply_batch", test_apply_batch},
+        {"checkpoint_after_remove", test_checkpoint_after_remove},
+        {"remove_value_copy_on_write", test_remove_value_copy_on_write},
+        {"clone_keeps_mapping", test_clone_keeps_mapping},
+        {"insert_text_stays_balanced", test_insert_text_stays_balanced},
+        {"string_only_compare", test_string_only_compare},
+        {"sharded_range_indices", test_sharded_range_indices},
+        {"journal_recovery", test_journal_recovery},
+        {"delta_codec", test_delta_codec},
+        {"concurrent_snapshots", test_concurrent_snapshots},
+        {"paging_random_ops", test_paging_random_ops},
+        {"newline_counts", test_newline_counts},
+        {"ingest_queue", test_ingest_queue},
+        {"mapped_tree", test_mapped_tree},
+    };
+    int failed = 0;
+    for (const auto &[name, test]: tests) {
+        try {
+            test();
+            std::cout << "[ OK ] " << name << std::endl;
+        } catch (const std::exception &e) {
+            std::cout << "[FAIL] " << name << ": " << e.what() << std::endl;
+            ++failed;
+        }
+    }
+    return failed == 0 ? 0 : 1;
+}